@@ -0,0 +1,177 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017 Gian-Carlo Pascutto
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "config.h"
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "FastBoard.h"
+#include "GameState.h"
+#include "GTP.h"
+#include "SMP.h"
+#include "Timing.h"
+#include "Training.h"
+#include "TTable.h"
+#include "UCTSearch.h"
+#include "Utils.h"
+
+using namespace Utils;
+
+namespace {
+
+struct BenchPosition {
+    const char * name;
+    const char * moves;
+};
+
+// Move sequences starting with black. Don't change these, or results
+// can no longer be compared with older ones.
+const BenchPosition bench_positions[] = {
+    { "empty", "" },
+    { "opening",
+      "q16 d4 q3 d16 c14 f17 c17 c16 d17 e17 "
+      "e18 b17 f18 g18 c18 b18 e16 d15 o17 r5" },
+    { "middlegame",
+      "q16 d4 q3 d16 c14 f17 c17 c16 d17 e17 "
+      "e18 b17 f18 g18 c18 b18 e16 d15 o17 r5 "
+      "q5 r6 r4 s4 s3 q6 p5 p6 o5 r8 "
+      "c6 f3 c3 c4 b4 d3 c2 d2 d6 f5 "
+      "k4 k3 j3 l3 j4 m4 k16 n3 o3 r12 "
+      "q11 q12 p12 p13 o12 r14 r15 o13 n13 n14" },
+};
+
+struct BenchResult {
+    int playouts{0};
+    int nodes{0};
+    int centiseconds{0};
+};
+
+BenchResult search_position(const GameState & position, int playouts) {
+    auto state = std::make_unique<GameState>(position);
+    // Plenty of time, the playout limit should end the search.
+    state->set_timecontrol(24 * 60 * 60 * 100, 0, 0, 0);
+
+    TTable::get_TT()->clear();
+
+    auto search = std::make_unique<UCTSearch>(*state);
+    search->set_playout_limit(playouts);
+
+    Time start;
+    search->think(state->get_to_move(), UCTSearch::NORESIGN);
+    Time end;
+
+    auto result = BenchResult{};
+    result.playouts = search->get_playouts();
+    result.nodes = search->get_nodes();
+    result.centiseconds = Time::timediff(start, end);
+    return result;
+}
+
+}
+
+void Benchmark::run(int playouts) {
+    auto positions = std::vector<GameState>{};
+    for (const auto& pos : bench_positions) {
+        auto state = GameState{};
+        state.init_game(19, 7.5f);
+        auto moves = std::istringstream{pos.moves};
+        auto color = std::string{"b"};
+        auto vertex = std::string{};
+        while (moves >> vertex) {
+            if (!state.play_textmove(color, vertex)) {
+                myprintf("Illegal move %s in benchmark position %s.\n",
+                         vertex.c_str(), pos.name);
+                return;
+            }
+            color = (color == "b" ? "w" : "b");
+        }
+        positions.emplace_back(state);
+    }
+
+    const auto max_threads = cfg_num_threads;
+    const auto was_quiet = cfg_quiet;
+    const auto smart_stop = cfg_smart_stop;
+    cfg_noise = false;
+    cfg_random_cnt = 0;
+    // Every search has to do the same amount of work.
+    cfg_smart_stop = false;
+
+    auto thread_counts = std::vector<int>{};
+    for (auto threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.emplace_back(threads);
+    }
+    thread_counts.emplace_back(max_threads);
+
+    myprintf("Benchmarking %d position(s), %d playouts per search.\n",
+             static_cast<int>(positions.size()), playouts);
+
+    // Warm up the network (kernel compilation, tuning) and the thread pool.
+    cfg_quiet = true;
+    search_position(positions.back(), std::max(1, playouts / 10));
+    cfg_quiet = was_quiet;
+
+    printf("%7s %9s %9s %7s %10s %12s %14s\n",
+           "threads", "playouts", "n/s", "speedup", "efficiency",
+           "tree nodes", "lock waits/1k");
+
+    auto base_nps = 0.0;
+    for (auto threads : thread_counts) {
+        cfg_num_threads = threads;
+        SMP::reset_lock_stats();
+
+        auto total = BenchResult{};
+        for (const auto& position : positions) {
+            cfg_quiet = true;
+            auto result = search_position(position, playouts);
+            cfg_quiet = was_quiet;
+            total.playouts += result.playouts;
+            total.nodes += result.nodes;
+            total.centiseconds += result.centiseconds;
+        }
+
+        auto lock_stats = SMP::get_lock_stats();
+        auto nps = (total.playouts * 100.0) / std::max(1, total.centiseconds);
+        if (threads == 1) {
+            base_nps = nps;
+        }
+        auto speedup = base_nps > 0.0 ? nps / base_nps : 0.0;
+        printf("%7d %9d %9.0f %6.2fx %9.1f%% %12d %14.1f\n",
+               threads, total.playouts, nps, speedup,
+               100.0 * speedup / threads, total.nodes,
+               (lock_stats.contended * 1000.0) / std::max(1, total.playouts));
+        if (lock_stats.contended) {
+            myprintf("  %llu contended lock acquisitions, "
+                     "%.1f spins, %.2f yields, %.2f sleeps per wait.\n",
+                     lock_stats.contended,
+                     double(lock_stats.spins) / lock_stats.contended,
+                     double(lock_stats.yields) / lock_stats.contended,
+                     double(lock_stats.sleeps) / lock_stats.contended);
+        }
+    }
+
+    cfg_num_threads = max_threads;
+    cfg_smart_stop = smart_stop;
+    Training::clear_training();
+}
@@ -0,0 +1,37 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017 Gian-Carlo Pascutto
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BENCHMARK_H_INCLUDED
+#define BENCHMARK_H_INCLUDED
+
+#include "config.h"
+
+class Benchmark {
+public:
+    /*
+        Search a fixed set of positions with a fixed number of
+        playouts, at 1, 2, 4, ... up to cfg_num_threads threads,
+        and report the throughput and scaling of each run.
+    */
+    static void run(int playouts);
+
+    static constexpr int DEFAULT_PLAYOUTS = 1600;
+};
+
+#endif
@@ -0,0 +1,236 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017 Gian-Carlo Pascutto
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BITBOARD_H_INCLUDED
+#define BITBOARD_H_INCLUDED
+
+#include "config.h"
+
+#include <array>
+#include <cassert>
+
+/*
+    One bit per point, for boards up to 19x19. Point (x, y) is bit
+    y * ROW + x. Rows are 20 bits apart so the bit after the last
+    column is never on the board: anything shifted sideways off an
+    edge lands there and is masked away.
+
+    The operations are plain loops over WORDS words with no branches,
+    which compilers turn into a handful of SSE or AVX instructions.
+*/
+class BitBoard {
+public:
+    static constexpr int ROW = 20;
+    static constexpr int WORDS = 6;
+    static constexpr int BITS = WORDS * 64;
+
+    BitBoard() = default;
+
+    static int index(int x, int y) {
+        return y * ROW + x;
+    }
+
+    // All points of a size x size board.
+    static BitBoard board_mask(int size) {
+        auto mask = BitBoard{};
+        for (auto y = 0; y < size; y++) {
+            for (auto x = 0; x < size; x++) {
+                mask.set(index(x, y));
+            }
+        }
+        return mask;
+    }
+
+    void set(int bit) {
+        assert(bit >= 0 && bit < BITS);
+        m_words[bit / 64] |= uint64{1} << (bit % 64);
+    }
+    void reset(int bit) {
+        assert(bit >= 0 && bit < BITS);
+        m_words[bit / 64] &= ~(uint64{1} << (bit % 64));
+    }
+    bool test(int bit) const {
+        assert(bit >= 0 && bit < BITS);
+        return (m_words[bit / 64] >> (bit % 64)) & 1;
+    }
+    void clear() {
+        m_words.fill(0);
+    }
+
+    bool empty() const {
+        auto any = uint64{0};
+        for (auto i = 0; i < WORDS; i++) {
+            any |= m_words[i];
+        }
+        return any == 0;
+    }
+
+    int count() const {
+        auto total = 0;
+        for (auto i = 0; i < WORDS; i++) {
+            total += popcount(m_words[i]);
+        }
+        return total;
+    }
+
+    bool operator==(const BitBoard & rhs) const {
+        auto diff = uint64{0};
+        for (auto i = 0; i < WORDS; i++) {
+            diff |= m_words[i] ^ rhs.m_words[i];
+        }
+        return diff == 0;
+    }
+    bool operator!=(const BitBoard & rhs) const {
+        return !(*this == rhs);
+    }
+
+    BitBoard operator&(const BitBoard & rhs) const {
+        auto res = BitBoard{};
+        for (auto i = 0; i < WORDS; i++) {
+            res.m_words[i] = m_words[i] & rhs.m_words[i];
+        }
+        return res;
+    }
+    BitBoard operator|(const BitBoard & rhs) const {
+        auto res = BitBoard{};
+        for (auto i = 0; i < WORDS; i++) {
+            res.m_words[i] = m_words[i] | rhs.m_words[i];
+        }
+        return res;
+    }
+    BitBoard operator^(const BitBoard & rhs) const {
+        auto res = BitBoard{};
+        for (auto i = 0; i < WORDS; i++) {
+            res.m_words[i] = m_words[i] ^ rhs.m_words[i];
+        }
+        return res;
+    }
+    // Bits of this that aren't in rhs.
+    BitBoard andnot(const BitBoard & rhs) const {
+        auto res = BitBoard{};
+        for (auto i = 0; i < WORDS; i++) {
+            res.m_words[i] = m_words[i] & ~rhs.m_words[i];
+        }
+        return res;
+    }
+    BitBoard & operator&=(const BitBoard & rhs) {
+        return *this = *this & rhs;
+    }
+    BitBoard & operator|=(const BitBoard & rhs) {
+        return *this = *this | rhs;
+    }
+
+    // Move every bit up (towards higher indexes) or down by n < 64.
+    BitBoard shift_up(int n) const {
+        auto res = BitBoard{};
+        res.m_words[0] = m_words[0] << n;
+        for (auto i = 1; i < WORDS; i++) {
+            res.m_words[i] = (m_words[i] << n) | (m_words[i - 1] >> (64 - n));
+        }
+        return res;
+    }
+    BitBoard shift_down(int n) const {
+        auto res = BitBoard{};
+        for (auto i = 0; i < WORDS - 1; i++) {
+            res.m_words[i] = (m_words[i] >> n) | (m_words[i + 1] << (64 - n));
+        }
+        res.m_words[WORDS - 1] = m_words[WORDS - 1] >> n;
+        return res;
+    }
+
+    // Points next to any of ours, not including ours, within mask.
+    BitBoard neighbours(const BitBoard & mask) const {
+        auto grown = shift_up(1) | shift_down(1)
+                     | shift_up(ROW) | shift_down(ROW);
+        return (grown & mask).andnot(*this);
+    }
+
+    // Everything in mask connected to seed through mask.
+    static BitBoard flood_fill(BitBoard seed, const BitBoard & mask) {
+        seed &= mask;
+        for (;;) {
+            auto grown = seed | seed.neighbours(mask);
+            if (grown == seed) {
+                return seed;
+            }
+            seed = grown;
+        }
+    }
+
+    // The string of stones through bit.
+    static BitBoard string_at(int bit, const BitBoard & stones) {
+        auto seed = BitBoard{};
+        seed.set(bit);
+        return flood_fill(seed, stones);
+    }
+
+    // Empty points next to a string.
+    static BitBoard liberties(const BitBoard & string,
+                              const BitBoard & empty) {
+        return string.neighbours(empty);
+    }
+
+    // All strings in stones without a liberty in empty.
+    static BitBoard dead_strings(const BitBoard & stones,
+                                 const BitBoard & empty) {
+        auto alive = flood_fill(empty.neighbours(stones), stones);
+        return stones.andnot(alive);
+    }
+
+    // Call f(bit) for every bit set, lowest first.
+    template<class F>
+    void for_each(F f) const {
+        for (auto i = 0; i < WORDS; i++) {
+            auto word = m_words[i];
+            while (word) {
+                f(i * 64 + lowest_bit(word));
+                word &= word - 1;
+            }
+        }
+    }
+
+private:
+    static int popcount(uint64 x) {
+#if defined(__GNUC__)
+        return __builtin_popcountll(x);
+#else
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return static_cast<int>((x * 0x0101010101010101ULL) >> 56);
+#endif
+    }
+
+    static int lowest_bit(uint64 x) {
+#if defined(__GNUC__)
+        return __builtin_ctzll(x);
+#else
+        auto n = 0;
+        while (!(x & 1)) {
+            x >>= 1;
+            n++;
+        }
+        return n;
+#endif
+    }
+
+    std::array<uint64, WORDS> m_words{};
+};
+
+#endif
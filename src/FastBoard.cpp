@@ -22,7 +22,6 @@
 #include <algorithm>
 #include <assert.h>
 #include <array>
-#include <queue>
 
 #include "config.h"
 
@@ -96,12 +95,65 @@ void FastBoard::set_square(int vertex, FastBoard::square_t content) {
     assert(content >= BLACK && content <= INVAL);
 
     m_square[vertex] = content;
+
+    if (content != INVAL) {
+        auto bit = vertex_to_bit(vertex);
+        m_bb_stones[BLACK].reset(bit);
+        m_bb_stones[WHITE].reset(bit);
+        if (content == BLACK || content == WHITE) {
+            m_bb_stones[content].set(bit);
+        }
+    }
+}
+
+int FastBoard::get_sym_vertex(int vertex, int symmetry) const {
+    assert(symmetry >= 0 && symmetry < 8);
+    auto x = (vertex % (m_boardsize + 2)) - 1;
+    auto y = (vertex / (m_boardsize + 2)) - 1;
+
+    if (symmetry >= 4) {
+        std::swap(x, y);
+        symmetry -= 4;
+    }
+    if (symmetry & 1) {
+        y = m_boardsize - y - 1;
+    }
+    if (symmetry & 2) {
+        x = m_boardsize - x - 1;
+    }
+
+    return get_vertex(x, y);
 }
 
 FastBoard::square_t FastBoard::get_square(int x, int y) const {
     return get_square(get_vertex(x,y));
 }
 
+const BitBoard & FastBoard::get_stones_bb(int color) const {
+    assert(color == BLACK || color == WHITE);
+    return m_bb_stones[color];
+}
+
+BitBoard FastBoard::get_empty_bb() const {
+    return m_bb_board.andnot(m_bb_stones[BLACK] | m_bb_stones[WHITE]);
+}
+
+const BitBoard & FastBoard::get_board_bb() const {
+    return m_bb_board;
+}
+
+int FastBoard::vertex_to_bit(int vertex) const {
+    auto x = (vertex % (m_boardsize + 2)) - 1;
+    auto y = (vertex / (m_boardsize + 2)) - 1;
+    assert(x >= 0 && x < m_boardsize);
+    assert(y >= 0 && y < m_boardsize);
+    return BitBoard::index(x, y);
+}
+
+int FastBoard::bit_to_vertex(int bit) const {
+    return get_vertex(bit % BitBoard::ROW, bit / BitBoard::ROW);
+}
+
 void FastBoard::set_square(int x, int y, FastBoard::square_t content) {
     set_square(get_vertex(x, y), content);
 }
@@ -115,6 +167,11 @@ void FastBoard::reset_board(int size) {
     m_totalstones[BLACK] = 0;
     m_totalstones[WHITE] = 0;
     m_empty_cnt = 0;
+    m_bb_stones[BLACK].clear();
+    m_bb_stones[WHITE].clear();
+    m_bb_board = BitBoard::board_mask(size);
+    m_bb_legal[BLACK].clear();
+    m_bb_legal[WHITE].clear();
 
     m_dirs[0] = -size-2;
     m_dirs[1] = +1;
@@ -165,9 +222,12 @@ void FastBoard::reset_board(int size) {
     m_parent[MAXSQ] = MAXSQ;
     m_libs[MAXSQ]   = 16384;    /* we will subtract from this */
     m_next[MAXSQ]   = MAXSQ;
+
+    calc_legal();
 }
 
-bool FastBoard::is_suicide(int i, int color) {
+template <int SIZE>
+bool FastBoard::is_suicide_impl(int i, int color) {
     if (count_pliberties(i)) {
         return false;
     }
@@ -175,7 +235,7 @@ bool FastBoard::is_suicide(int i, int color) {
     bool connecting = false;
 
     for (int k = 0; k < 4; k++) {
-        int ai = i + m_dirs[k];
+        int ai = i + dir<SIZE>(k);
 
         int libs = m_libs[m_parent[ai]];
         if (get_square(ai) == color) {
@@ -192,13 +252,13 @@ bool FastBoard::is_suicide(int i, int color) {
         }
     }
 
-    add_neighbour(i, color);
+    add_neighbour<SIZE>(i, color);
 
     bool opps_live = true;
     bool ours_die = true;
 
     for (int k = 0; k < 4; k++) {
-        int ai = i + m_dirs[k];
+        int ai = i + dir<SIZE>(k);
 
         int libs = m_libs[m_parent[ai]];
 
@@ -209,7 +269,7 @@ bool FastBoard::is_suicide(int i, int color) {
         }
     }
 
-    remove_neighbour(i, color);
+    remove_neighbour<SIZE>(i, color);
 
     if (!connecting) {
         return opps_live;
@@ -218,6 +278,78 @@ bool FastBoard::is_suicide(int i, int color) {
     }
 }
 
+bool FastBoard::is_suicide(int i, int color) {
+    if (m_boardsize == MAXBOARDSIZE) {
+        return is_suicide_impl<MAXBOARDSIZE>(i, color);
+    }
+    return is_suicide_impl<0>(i, color);
+}
+
+// Same answer as !is_suicide, without touching the board. Ko is not
+// considered here, that is up to the caller.
+template <int SIZE>
+bool FastBoard::check_legal(const int i, const int color) const {
+    if ((m_neighbours[i] >> (NBR_SHIFT * EMPTY)) & 7) {
+        return true;
+    }
+
+    for (int k = 0; k < 4; k++) {
+        int ai = i + dir<SIZE>(k);
+
+        int libs = m_libs[m_parent[ai]];
+        if (m_square[ai] == color) {
+            if (libs > 1) {
+                return true;
+            }
+        } else if (libs <= 1) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const BitBoard & FastBoard::get_legal_bb(int color) const {
+    assert(color == BLACK || color == WHITE);
+    return m_bb_legal[color];
+}
+
+template <int SIZE>
+void FastBoard::update_legal(const int vertex) {
+    auto bit = to_bit<SIZE>(vertex);
+    for (auto color : {BLACK, WHITE}) {
+        if (m_square[vertex] == EMPTY && check_legal<SIZE>(vertex, color)) {
+            m_bb_legal[color].set(bit);
+        } else {
+            m_bb_legal[color].reset(bit);
+        }
+    }
+}
+
+// Refresh the empty points next to the string at vertex, after its
+// liberty count crossed 1.
+template <int SIZE>
+void FastBoard::update_legal_libs(const int vertex) {
+    int pos = vertex;
+    do {
+        for (int k = 0; k < 4; k++) {
+            int ai = pos + dir<SIZE>(k);
+            if (m_square[ai] == EMPTY) {
+                update_legal<SIZE>(ai);
+            }
+        }
+        pos = m_next[pos];
+    } while (pos != vertex);
+}
+
+void FastBoard::calc_legal() {
+    m_bb_legal[BLACK].clear();
+    m_bb_legal[WHITE].clear();
+    for (int i = 0; i < m_empty_cnt; i++) {
+        update_legal(m_empty[i]);
+    }
+}
+
 int FastBoard::count_pliberties(const int i) {
     return count_neighbours(EMPTY, i);
 }
@@ -229,6 +361,7 @@ int FastBoard::count_neighbours(const int c, const int v) {
     return (m_neighbours[v] >> (NBR_SHIFT * c)) & 7;
 }
 
+template <int SIZE>
 void FastBoard::add_neighbour(const int vtx, const int color) {
     assert(color == WHITE || color == BLACK || color == EMPTY);
 
@@ -236,7 +369,7 @@ void FastBoard::add_neighbour(const int vtx, const int color) {
     int nbr_par_cnt = 0;
 
     for (int k = 0; k < 4; k++) {
-        int ai = vtx + m_dirs[k];
+        int ai = vtx + dir<SIZE>(k);
 
         m_neighbours[ai] += (1 << (NBR_SHIFT * color)) - (1 << (NBR_SHIFT * EMPTY));
 
@@ -254,6 +387,7 @@ void FastBoard::add_neighbour(const int vtx, const int color) {
     }
 }
 
+template <int SIZE>
 void FastBoard::remove_neighbour(const int vtx, const int color) {
     assert(color == WHITE || color == BLACK || color == EMPTY);
 
@@ -261,7 +395,7 @@ void FastBoard::remove_neighbour(const int vtx, const int color) {
     int nbr_par_cnt = 0;
 
     for (int k = 0; k < 4; k++) {
-        int ai = vtx + m_dirs[k];
+        int ai = vtx + dir<SIZE>(k);
 
         m_neighbours[ai] += (1 << (NBR_SHIFT * EMPTY))
                           - (1 << (NBR_SHIFT * color));
@@ -292,6 +426,8 @@ int FastBoard::remove_string_fast(int i) {
 
         m_square[pos]  = EMPTY;
         m_parent[pos]  = MAXSQ;
+        m_bb_stones[BLACK].reset(vertex_to_bit(pos));
+        m_bb_stones[WHITE].reset(vertex_to_bit(pos));
         m_totalstones[color]--;
 
         remove_neighbour(pos, color);
@@ -307,54 +443,24 @@ int FastBoard::remove_string_fast(int i) {
     return removed;
 }
 
-std::vector<bool> FastBoard::calc_reach_color(int col) {
-    auto bd = std::vector<bool>(m_maxsq, false);
-    auto open = std::queue<int>();
-    for (auto i = 0; i < m_boardsize; i++) {
-        for (auto j = 0; j < m_boardsize; j++) {
-            auto vertex = get_vertex(i, j);
-            if (m_square[vertex] == col) {
-                bd[vertex] = true;
-                open.push(vertex);
-            }
-        }
-    }
-    while (!open.empty()) {
-        /* colored field, spread */
-        auto vertex = open.front();
-        open.pop();
-
-        for (auto k = 0; k < 4; k++) {
-            auto neighbor = vertex + m_dirs[k];
-            if (!bd[neighbor] && m_square[neighbor] == EMPTY) {
-                bd[neighbor] = true;
-                open.push(neighbor);
-            }
-        }
-    }
-    return bd;
+// Stones of col plus every empty region that touches them.
+BitBoard FastBoard::calc_reach_color(int col) const {
+    auto empty = get_empty_bb();
+    auto& stones = m_bb_stones[col];
+    return stones | BitBoard::flood_fill(stones.neighbours(empty), empty);
 }
 
-// Needed for scoring passed out games not in MC playouts
-float FastBoard::area_score(float komi) {
-    auto white = calc_reach_color(WHITE);
-    auto black = calc_reach_color(BLACK);
-
-    auto score = -komi;
-
-    for (int i = 0; i < m_boardsize; i++) {
-        for (int j = 0; j < m_boardsize; j++) {
-            auto vertex = get_vertex(i, j);
+// Points that count for col under area scoring.
+BitBoard FastBoard::get_ownership(int col) const {
+    return calc_reach_color(col).andnot(calc_reach_color(!col));
+}
 
-            if (white[vertex] && !black[vertex]) {
-                score -= 1.0f;
-            } else if (black[vertex] && !white[vertex]) {
-                score += 1.0f;
-            }
-        }
-    }
+// Needed for scoring passed out games not in MC playouts
+float FastBoard::area_score(float komi) const {
+    auto black = get_ownership(BLACK).count();
+    auto white = get_ownership(WHITE).count();
 
-    return score;
+    return black - white - komi;
 }
 
 int FastBoard::estimate_mc_score(float komi) {
@@ -436,6 +542,7 @@ void FastBoard::display_board(int lastmove) {
     myprintf("\n\n");
 }
 
+template <int SIZE>
 void FastBoard::merge_strings(const int ip, const int aip) {
     assert(ip != MAXSQ && aip != MAXSQ);
 
@@ -448,13 +555,13 @@ void FastBoard::merge_strings(const int ip, const int aip) {
     do {
         // check if this stone has a liberty
         for (int k = 0; k < 4; k++) {
-            int ai = newpos + m_dirs[k];
+            int ai = newpos + dir<SIZE>(k);
             // for each liberty, check if it is not shared
             if (m_square[ai] == EMPTY) {
                 // find liberty neighbors
                 bool found = false;
                 for (int kk = 0; kk < 4; kk++) {
-                    int aai = ai + m_dirs[kk];
+                    int aai = ai + dir<SIZE>(kk);
                     // friendly string shouldn't be ip
                     // ip can also be an aip that has been marked
                     if (m_parent[aai] == ip) {
@@ -479,7 +586,8 @@ void FastBoard::merge_strings(const int ip, const int aip) {
     m_next[ip] = tmp;
 }
 
-bool FastBoard::is_eye(const int color, const int i) {
+template <int SIZE>
+bool FastBoard::is_eye_impl(const int color, const int i) {
     /* check for 4 neighbors of the same color */
     int ownsurrounded = (m_neighbours[i] & s_eyemask[color]);
 
@@ -498,10 +606,10 @@ bool FastBoard::is_eye(const int color, const int i) {
     colorcount[WHITE] = 0;
     colorcount[INVAL] = 0;
 
-    colorcount[m_square[i - 1 - m_boardsize - 2]]++;
-    colorcount[m_square[i + 1 - m_boardsize - 2]]++;
-    colorcount[m_square[i - 1 + m_boardsize + 2]]++;
-    colorcount[m_square[i + 1 + m_boardsize + 2]]++;
+    colorcount[m_square[i - 1 - stride<SIZE>()]]++;
+    colorcount[m_square[i + 1 - stride<SIZE>()]]++;
+    colorcount[m_square[i - 1 + stride<SIZE>()]]++;
+    colorcount[m_square[i + 1 + stride<SIZE>()]]++;
 
     if (colorcount[INVAL] == 0) {
         if (colorcount[!color] > 1) {
@@ -516,6 +624,13 @@ bool FastBoard::is_eye(const int color, const int i) {
     return true;
 }
 
+bool FastBoard::is_eye(const int color, const int i) {
+    if (m_boardsize == MAXBOARDSIZE) {
+        return is_eye_impl<MAXBOARDSIZE>(color, i);
+    }
+    return is_eye_impl<0>(color, i);
+}
+
 std::string FastBoard::move_to_text(int move) {
     std::ostringstream result;
 
@@ -671,3 +786,15 @@ std::string FastBoard::get_stone_list() {
 
     return res;
 }
+
+// Used by FullBoard::update_board for the general and the 19x19 case.
+template void FastBoard::merge_strings<0>(int, int);
+template void FastBoard::merge_strings<FastBoard::MAXBOARDSIZE>(int, int);
+template void FastBoard::add_neighbour<0>(int, int);
+template void FastBoard::add_neighbour<FastBoard::MAXBOARDSIZE>(int, int);
+template void FastBoard::remove_neighbour<0>(int, int);
+template void FastBoard::remove_neighbour<FastBoard::MAXBOARDSIZE>(int, int);
+template void FastBoard::update_legal<0>(int);
+template void FastBoard::update_legal<FastBoard::MAXBOARDSIZE>(int);
+template void FastBoard::update_legal_libs<0>(int);
+template void FastBoard::update_legal_libs<FastBoard::MAXBOARDSIZE>(int);
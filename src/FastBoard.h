@@ -23,9 +23,12 @@
 
 #include <array>
 #include <string>
+#include <type_traits>
 #include <vector>
 #include <queue>
 
+#include "BitBoard.h"
+
 class FastBoard {
     friend class FastState;
 public:
@@ -79,6 +82,18 @@ public:
     void set_square(int x, int y, square_t content);
     void set_square(int vertex, square_t content);
     std::pair<int, int> get_xy(int vertex) const;
+    // Same numbering as Network::rotate_nn_idx.
+    int get_sym_vertex(int vertex, int symmetry) const;
+
+    // Bitboard copies of the board, kept up to date on every change.
+    const BitBoard & get_stones_bb(int color) const;
+    BitBoard get_empty_bb() const;
+    const BitBoard & get_board_bb() const;
+    int vertex_to_bit(int vertex) const;
+    int bit_to_vertex(int bit) const;
+
+    // Points each side may play without suicide, ko excluded.
+    const BitBoard & get_legal_bb(int color) const;
 
     bool is_suicide(int i, int color);
     int count_pliberties(const int i);
@@ -89,8 +104,9 @@ public:
 
     int estimate_mc_score(float komi);
     float final_mc_score(float komi);
-    float area_score(float komi);
-    std::vector<bool> calc_reach_color(int col);
+    float area_score(float komi) const;
+    BitBoard calc_reach_color(int col) const;
+    BitBoard get_ownership(int col) const;
 
     int get_prisoners(int side);
     bool black_to_move();
@@ -115,31 +131,75 @@ protected:
     static const std::array<int,      2> s_eyemask;
     static const std::array<square_t, 4> s_cinvert; /* color inversion */
 
-    std::array<square_t, MAXSQ>            m_square;      /* board contents */
-    std::array<unsigned short, MAXSQ+1>    m_next;        /* next stone in string */
-    std::array<unsigned short, MAXSQ+1>    m_parent;      /* parent node of string */
-    std::array<unsigned short, MAXSQ+1>    m_libs;        /* liberties per string parent */
-    std::array<unsigned short, MAXSQ+1>    m_stones;      /* stones per string parent */
-    std::array<unsigned short, MAXSQ>      m_neighbours;  /* counts of neighboring stones */
+    /*
+        Everything below is plain data with no heap members, so a board
+        (and the states built on it) copies as one flat block.
+    */
+    int m_boardsize;
+    int m_maxsq;
+    int m_tomove;
+    int m_empty_cnt;                                      /* count of empties */
     std::array<int, 4>                     m_dirs;        /* movement directions 4 way */
     std::array<int, 8>                     m_extradirs;   /* movement directions 8 way */
     std::array<int, 2>                     m_prisoners;   /* prisoners per color */
     std::array<int, 2>                     m_totalstones; /* stones per color */
-    std::vector<int>                       m_critical;    /* queue of critical points */
+    std::array<BitBoard, 2>                m_bb_stones;   /* stones per color */
+    BitBoard                               m_bb_board;    /* points on the board */
+    std::array<BitBoard, 2>                m_bb_legal;    /* non-suicide empties */
+    std::array<square_t, MAXSQ>            m_square;      /* board contents */
+    std::array<unsigned short, MAXSQ>      m_neighbours;  /* counts of neighboring stones */
+    std::array<unsigned short, MAXSQ+1>    m_parent;      /* parent node of string */
+    std::array<unsigned short, MAXSQ+1>    m_libs;        /* liberties per string parent */
+    std::array<unsigned short, MAXSQ+1>    m_next;        /* next stone in string */
+    std::array<unsigned short, MAXSQ+1>    m_stones;      /* stones per string parent */
     std::array<unsigned short, MAXSQ>      m_empty;       /* empty squares */
     std::array<unsigned short, MAXSQ>      m_empty_idx;   /* indexes of square */
-    int m_empty_cnt;                                      /* count of empties */
 
-    int m_tomove;
-    int m_maxsq;
-
-    int m_boardsize;
+    /*
+        Board geometry for a SIZE x SIZE board, or for m_boardsize when
+        SIZE is 0. The 19x19 instances of the hot paths get every
+        neighbour offset and index as a constant.
+    */
+    template <int SIZE = 0>
+    int stride() const {
+        return SIZE ? SIZE + 2 : m_boardsize + 2;
+    }
+    template <int SIZE = 0>
+    int dir(const int k) const {
+        if (SIZE == 0) {
+            return m_dirs[k];
+        }
+        return k == 0 ? -stride<SIZE>() : k == 1 ? 1
+             : k == 2 ? stride<SIZE>() : -1;
+    }
+    template <int SIZE = 0>
+    int to_bit(const int vertex) const {
+        return BitBoard::index(vertex % stride<SIZE>() - 1,
+                               vertex / stride<SIZE>() - 1);
+    }
 
     int count_neighbours(const int color, const int i);
+    template <int SIZE = 0>
     void merge_strings(const int ip, const int aip);
     int remove_string_fast(int i);
+    template <int SIZE = 0>
     void add_neighbour(const int i, const int color);
+    template <int SIZE = 0>
     void remove_neighbour(const int i, const int color);
+    template <int SIZE>
+    bool is_suicide_impl(int i, int color);
+    template <int SIZE>
+    bool is_eye_impl(const int color, const int i);
+    template <int SIZE = 0>
+    bool check_legal(const int i, const int color) const;
+    template <int SIZE = 0>
+    void update_legal(const int vertex);
+    template <int SIZE = 0>
+    void update_legal_libs(const int vertex);
+    void calc_legal();
 };
 
+static_assert(std::is_trivially_copyable<FastBoard>::value,
+              "FastBoard must stay a flat copyable block");
+
 #endif
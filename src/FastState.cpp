@@ -71,13 +71,12 @@ std::vector<int> FastState::generate_moves(int color) {
 
     result.reserve(board.m_empty_cnt);
 
-    for (int i = 0; i < board.m_empty_cnt; i++) {
-        int vertex = board.m_empty[i];
-
-        if (vertex != m_komove && !board.is_suicide(vertex, color)) {
+    board.get_legal_bb(color).for_each([&](int bit) {
+        auto vertex = board.bit_to_vertex(bit);
+        if (vertex != m_komove) {
             result.push_back(vertex);
         }
-    }
+    });
 
     result.push_back(FastBoard::PASS);
 
@@ -187,8 +186,7 @@ std::string FastState::move_to_text(int move) {
 }
 
 float FastState::final_score() {
-    FastState workstate(*this);
-    return workstate.board.area_score(get_komi() + get_handicap());
+    return board.area_score(get_komi() + get_handicap());
 }
 
 float FastState::get_komi() const {
@@ -27,6 +27,7 @@
 
 using namespace Utils;
 
+template <int SIZE>
 int FullBoard::remove_string(int i) {
     int pos = i;
     int removed = 0;
@@ -35,12 +36,14 @@ int FullBoard::remove_string(int i) {
     do {
         m_hash    ^= Zobrist::zobrist[m_square[pos]][pos];
         m_ko_hash ^= Zobrist::zobrist[m_square[pos]][pos];
+        update_sym_hash<SIZE>(pos, color, EMPTY);
 
         m_square[pos] = EMPTY;
         m_parent[pos] = MAXSQ;
+        m_bb_stones[color].reset(to_bit<SIZE>(pos));
         m_totalstones[color]--;
 
-        remove_neighbour(pos, color);
+        remove_neighbour<SIZE>(pos, color);
 
         m_empty_idx[pos]      = m_empty_cnt;
         m_empty[m_empty_cnt]  = pos;
@@ -80,6 +83,16 @@ uint64 FullBoard::calc_hash(void) {
         }
     }
 
+    m_sym_hash.fill(0);
+    for (int i = 0; i < m_maxsq; i++) {
+        if (m_square[i] != INVAL) {
+            for (int s = 0; s < 8; s++) {
+                auto sym = get_sym_vertex(i, s);
+                m_sym_hash[s] ^= Zobrist::zobrist[m_square[i]][sym];
+            }
+        }
+    }
+
     /* prisoner hashing is rule set dependent */
     res ^= Zobrist::zobrist_pris[0][m_prisoners[0]];
     res ^= Zobrist::zobrist_pris[1][m_prisoners[1]];
@@ -101,13 +114,53 @@ uint64 FullBoard::get_ko_hash(void) const {
     return m_ko_hash;
 }
 
-int FullBoard::update_board(const int color, const int i, bool &capture) {
+int FullBoard::get_canonical_symmetry(void) const {
+    auto best = 0;
+    for (int s = 1; s < 8; s++) {
+        if (m_sym_hash[s] < m_sym_hash[best]) {
+            best = s;
+        }
+    }
+    return best;
+}
+
+uint64 FullBoard::get_canonical_hash(void) const {
+    // m_hash ^ m_sym_hash[0] leaves only the orientation independent
+    // terms: side to move, passes and prisoners.
+    return m_hash ^ m_sym_hash[0] ^ m_sym_hash[get_canonical_symmetry()];
+}
+
+template <int SIZE>
+void FullBoard::update_sym_hash(int vertex, int from, int to) {
+    auto row = stride<SIZE>();
+    auto last = row - 3;
+    auto x = (vertex % row) - 1;
+    auto y = (vertex / row) - 1;
+    auto sym = std::array<int, 8>{
+        (y + 1) * row + (x + 1),
+        (last - y + 1) * row + (x + 1),
+        (y + 1) * row + (last - x + 1),
+        (last - y + 1) * row + (last - x + 1),
+        (x + 1) * row + (y + 1),
+        (last - x + 1) * row + (y + 1),
+        (x + 1) * row + (last - y + 1),
+        (last - x + 1) * row + (last - y + 1)
+    };
+    for (int s = 0; s < 8; s++) {
+        m_sym_hash[s] ^= Zobrist::zobrist[from][sym[s]]
+                       ^ Zobrist::zobrist[to][sym[s]];
+    }
+}
+
+template <int SIZE>
+int FullBoard::update_board_impl(const int color, const int i, bool &capture) {
     assert(m_square[i] == EMPTY);
 
     m_hash ^= Zobrist::zobrist[m_square[i]][i];
     m_ko_hash ^= Zobrist::zobrist[m_square[i]][i];
 
     m_square[i] = (square_t)color;
+    m_bb_stones[color].set(to_bit<SIZE>(i));
     m_next[i] = i;
     m_parent[i] = i;
     m_libs[i] = count_pliberties(i);
@@ -116,9 +169,10 @@ int FullBoard::update_board(const int color, const int i, bool &capture) {
 
     m_hash ^= Zobrist::zobrist[m_square[i]][i];
     m_ko_hash ^= Zobrist::zobrist[m_square[i]][i];
+    update_sym_hash<SIZE>(i, EMPTY, color);
 
     /* update neighbor liberties (they all lose 1) */
-    add_neighbour(i, color);
+    add_neighbour<SIZE>(i, color);
 
     /* did we play into an opponent eye? */
     int eyeplay = (m_neighbours[i] & s_eyemask[!color]);
@@ -127,11 +181,11 @@ int FullBoard::update_board(const int color, const int i, bool &capture) {
     int captured_stones = 0;
 
     for (int k = 0; k < 4; k++) {
-        int ai = i + m_dirs[k];
+        int ai = i + dir<SIZE>(k);
 
         if (m_square[ai] == !color) {
             if (m_libs[m_parent[ai]] <= 0) {
-                int this_captured = remove_string(ai);
+                int this_captured = remove_string<SIZE>(ai);
                 captured_sq = ai;
                 captured_stones += this_captured;
             }
@@ -141,9 +195,9 @@ int FullBoard::update_board(const int color, const int i, bool &capture) {
 
             if (ip != aip) {
                 if (m_stones[ip] >= m_stones[aip]) {
-                    merge_strings(ip, aip);
+                    merge_strings<SIZE>(ip, aip);
                 } else {
-                    merge_strings(aip, ip);
+                    merge_strings<SIZE>(aip, ip);
                 }
             }
         }
@@ -164,6 +218,26 @@ int FullBoard::update_board(const int color, const int i, bool &capture) {
         remove_string_fast(i);
     }
 
+    if (captured_stones || m_square[i] == EMPTY) {
+        calc_legal();
+    } else {
+        /* only strings whose liberty count dropped to 1 change the
+           status of points further away */
+        update_legal<SIZE>(i);
+        for (int k = 0; k < 4; k++) {
+            int ai = i + dir<SIZE>(k);
+            if (m_square[ai] == EMPTY) {
+                update_legal<SIZE>(ai);
+            } else if (m_square[ai] == !color
+                       && m_libs[m_parent[ai]] == 1) {
+                update_legal_libs<SIZE>(ai);
+            }
+        }
+        if (m_libs[m_parent[i]] == 1) {
+            update_legal_libs<SIZE>(i);
+        }
+    }
+
     if (captured_stones) {
         capture = true;
         /* check for possible simple ko */
@@ -175,6 +249,13 @@ int FullBoard::update_board(const int color, const int i, bool &capture) {
     return -1;
 }
 
+int FullBoard::update_board(const int color, const int i, bool &capture) {
+    if (m_boardsize == MAXBOARDSIZE) {
+        return update_board_impl<MAXBOARDSIZE>(color, i, capture);
+    }
+    return update_board_impl<0>(color, i, capture);
+}
+
 void FullBoard::display_board(int lastmove) {
     FastBoard::display_board(lastmove);
 
@@ -187,3 +268,5 @@ void FullBoard::reset_board(int size) {
     calc_hash();
     calc_ko_hash();
 }
+
+template int FullBoard::remove_string<0>(int);
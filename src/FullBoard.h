@@ -20,10 +20,15 @@
 #define FULLBOARD_H_INCLUDED
 
 #include "config.h"
+
+#include <array>
+#include <type_traits>
+
 #include "FastBoard.h"
 
 class FullBoard : public FastBoard {
 public:
+    template <int SIZE = 0>
     int remove_string(int i);
     int update_board(const int color, const int i, bool & capture);
 
@@ -31,12 +36,27 @@ public:
     uint64 calc_ko_hash(void);
     uint64 get_hash(void) const;
     uint64 get_ko_hash(void) const;
+    // Hash shared by all 8 rotations and reflections of the position.
+    uint64 get_canonical_hash(void) const;
+    // Symmetry taking this position to the canonical orientation.
+    int get_canonical_symmetry(void) const;
 
     void reset_board(int size);
     void display_board(int lastmove = -1);
 
     uint64 m_hash;
     uint64 m_ko_hash;
+    /* board contents part of the hash, under each symmetry */
+    std::array<uint64, 8> m_sym_hash;
+
+private:
+    template <int SIZE>
+    int update_board_impl(const int color, const int i, bool & capture);
+    template <int SIZE>
+    void update_sym_hash(int vertex, int from, int to);
 };
 
+static_assert(std::is_trivially_copyable<FullBoard>::value,
+              "FullBoard must stay a flat copyable block");
+
 #endif
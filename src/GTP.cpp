@@ -34,6 +34,7 @@
 #include "GameState.h"
 #include "GTP.h"
 #include "UCTSearch.h"
+#include "SearchStats.h"
 #include "UCTNode.h"
 #include "SGFTree.h"
 #include "Network.h"
@@ -45,13 +46,19 @@ using namespace Utils;
 // Configuration flags
 bool cfg_allow_pondering;
 int cfg_num_threads;
+int cfg_sims_per_thread;
+int cfg_nn_threads;
+bool cfg_affinity;
+bool cfg_deterministic;
 int cfg_max_playouts;
+size_t cfg_max_tree_memory;
 int cfg_lagbuffer_cs;
 int cfg_resignpct;
 int cfg_noise;
 int cfg_random_cnt;
 uint64 cfg_rng_seed;
 bool cfg_dumbpass;
+bool cfg_smart_stop;
 #ifdef USE_OPENCL
 std::vector<int> cfg_gpus;
 int cfg_rowtiles;
@@ -66,7 +73,12 @@ bool cfg_quiet;
 void GTP::setup_default_parameters() {
     cfg_allow_pondering = true;
     cfg_num_threads = std::max(1, std::min(SMP::get_num_cpus(), MAX_CPUS));
+    cfg_sims_per_thread = 1;
+    cfg_nn_threads = 2;
+    cfg_affinity = false;
+    cfg_deterministic = false;
     cfg_max_playouts = std::numeric_limits<decltype(cfg_max_playouts)>::max();
+    cfg_max_tree_memory = UCTSearch::DEFAULT_MAX_TREE_MEMORY;
     cfg_lagbuffer_cs = 100;
 #ifdef USE_OPENCL
     cfg_gpus = { };
@@ -78,6 +90,7 @@ void GTP::setup_default_parameters() {
     cfg_noise = false;
     cfg_random_cnt = 0;
     cfg_dumbpass = false;
+    cfg_smart_stop = true;
     cfg_logfile_handle = nullptr;
     cfg_quiet = false;
 
@@ -121,9 +134,19 @@ const std::string GTP::s_commands[] = {
     "kgs-time_settings",
     "kgs-game_over",
     "heatmap",
+    "search_stats",
     ""
 };
 
+std::unique_ptr<UCTSearch> GTP::s_search;
+
+UCTSearch & GTP::get_search(GameState & game) {
+    if (!s_search || &s_search->get_rootstate() != &game) {
+        s_search = std::make_unique<UCTSearch>(game);
+    }
+    return *s_search;
+}
+
 std::string GTP::get_life_list(GameState & game, bool live) {
     std::vector<std::string> stringlist;
     std::string result;
@@ -309,6 +332,10 @@ bool GTP::execute(GameState & game, std::string xinput) {
                     gtp_fail_printf(id, "illegal move");
                 } else {
                     gtp_printf(id, "");
+                    // Move the tree along with the game.
+                    if (s_search) {
+                        s_search->update_root();
+                    }
                 }
             } else {
                 gtp_fail_printf(id, "syntax not understood");
@@ -334,9 +361,9 @@ bool GTP::execute(GameState & game, std::string xinput) {
             }
             // start thinking
             {
-                auto search = std::make_unique<UCTSearch>(game);
+                auto& search = get_search(game);
 
-                int move = search->think(who);
+                int move = search.think(who);
                 game.play_move(who, move);
 
                 std::string vertex = game.move_to_text(move);
@@ -345,8 +372,8 @@ bool GTP::execute(GameState & game, std::string xinput) {
             if (cfg_allow_pondering) {
                 // now start pondering
                 if (game.get_last_move() != FastBoard::RESIGN) {
-                    auto search = std::make_unique<UCTSearch>(game);
-                    search->ponder();
+                    auto& search = get_search(game);
+                    search.ponder();
                 }
             }
         } else {
@@ -372,9 +399,9 @@ bool GTP::execute(GameState & game, std::string xinput) {
             }
             game.set_passes(0);
             {
-                auto search = std::make_unique<UCTSearch>(game);
+                auto& search = get_search(game);
 
-                int move = search->think(who, UCTSearch::NOPASS);
+                int move = search.think(who, UCTSearch::NOPASS);
                 game.play_move(who, move);
 
                 std::string vertex = game.move_to_text(move);
@@ -383,8 +410,8 @@ bool GTP::execute(GameState & game, std::string xinput) {
             if (cfg_allow_pondering) {
                 // now start pondering
                 if (game.get_last_move() != FastBoard::RESIGN) {
-                    auto search = std::make_unique<UCTSearch>(game);
-                    search->ponder();
+                    auto& search = get_search(game);
+                    search.ponder();
                 }
             }
         } else {
@@ -478,8 +505,8 @@ bool GTP::execute(GameState & game, std::string xinput) {
                 // KGS sends this after our move
                 // now start pondering
                 if (game.get_last_move() != FastBoard::RESIGN) {
-                    auto search = std::make_unique<UCTSearch>(game);
-                    search->ponder();
+                    auto& search = get_search(game);
+                    search.ponder();
                 }
             }
         } else {
@@ -488,9 +515,9 @@ bool GTP::execute(GameState & game, std::string xinput) {
         return true;
     } else if (command.find("auto") == 0) {
         do {
-            auto search = std::make_unique<UCTSearch>(game);
+            auto& search = get_search(game);
 
-            int move = search->think(game.get_to_move(), UCTSearch::NORMAL);
+            int move = search.think(game.get_to_move(), UCTSearch::NORMAL);
             game.play_move(move);
             game.display_state();
 
@@ -499,9 +526,9 @@ bool GTP::execute(GameState & game, std::string xinput) {
 
         return true;
     } else if (command.find("go") == 0) {
-        auto search = std::make_unique<UCTSearch>(game);
+        auto& search = get_search(game);
 
-        int move = search->think(game.get_to_move());
+        int move = search.think(game.get_to_move());
         game.play_move(move);
 
         std::string vertex = game.move_to_text(move);
@@ -676,6 +703,30 @@ bool GTP::execute(GameState & game, std::string xinput) {
         gtp_printf(id, "");
         return true;
 
+    } else if (command.find("search_stats") == 0) {
+        std::istringstream cmdstream(command);
+        std::string tmp, action;
+
+        cmdstream >> tmp;  // eat search_stats
+        cmdstream >> action;
+
+        if (cmdstream.fail()) {
+            auto table = SearchStats::table(SearchStats::collect());
+            gtp_printf(id, "%s\n%s",
+                       SearchStats::enabled() ? "on" : "off", table.c_str());
+        } else if (action == "on") {
+            SearchStats::set_enabled(true);
+            gtp_printf(id, "");
+        } else if (action == "off") {
+            SearchStats::set_enabled(false);
+            gtp_printf(id, "");
+        } else if (action == "reset") {
+            SearchStats::reset();
+            gtp_printf(id, "");
+        } else {
+            gtp_fail_printf(id, "syntax not understood");
+        }
+        return true;
     } else if (command.find("printsgf") == 0) {
         std::istringstream cmdstream(command);
         std::string tmp, filename;
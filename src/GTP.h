@@ -19,19 +19,26 @@
 #ifndef GTP_H_INCLUDED
 #define GTP_H_INCLUDED
 
+#include <memory>
 #include <string>
 #include <vector>
 #include "GameState.h"
 
 extern bool cfg_allow_pondering;
 extern int cfg_num_threads;
+extern int cfg_sims_per_thread;
+extern int cfg_nn_threads;
+extern bool cfg_affinity;
+extern bool cfg_deterministic;
 extern int cfg_max_playouts;
+extern size_t cfg_max_tree_memory;
 extern int cfg_lagbuffer_cs;
 extern int cfg_resignpct;
 extern int cfg_noise;
 extern int cfg_random_cnt;
 extern uint64 cfg_rng_seed;
 extern bool cfg_dumbpass;
+extern bool cfg_smart_stop;
 #ifdef USE_OPENCL
 extern std::vector<int> cfg_gpus;
 extern int cfg_rowtiles;
@@ -43,6 +50,8 @@ extern std::string cfg_weightsfile;
 extern FILE* cfg_logfile_handle;
 extern bool cfg_quiet;
 
+class UCTSearch;
+
 class GTP {
 public:
     static bool execute(GameState & game, std::string xinput);
@@ -51,7 +60,10 @@ private:
     static constexpr int GTP_VERSION = 2;
 
     static std::string get_life_list(GameState & game, bool live);
+    static UCTSearch & get_search(GameState & game);
     static const std::string s_commands[];
+    // Kept between commands so that the tree can be reused.
+    static std::unique_ptr<UCTSearch> s_search;
 };
 
 
@@ -36,8 +36,9 @@
 void GameState::init_game(int size, float komi) {
     KoState::init_game(size, komi);
 
-    game_history.clear();
-    game_history.emplace_back(std::make_shared<KoState>(*this));
+    game_history.reset();
+    m_redo.clear();
+    push_game_history();
 
     m_timecontrol.set_boardsize(board.get_boardsize());
     m_timecontrol.reset_clocks();
@@ -48,16 +49,23 @@ void GameState::init_game(int size, float komi) {
 void GameState::reset_game() {
     KoState::reset_game();
 
-    game_history.clear();
-    game_history.emplace_back(std::make_shared<KoState>(*this));
+    game_history.reset();
+    m_redo.clear();
+    push_game_history();
 
     m_timecontrol.reset_clocks();
 }
 
+void GameState::push_game_history() {
+    game_history = std::make_shared<const HistoryNode>(
+        HistoryNode{std::make_shared<const KoState>(*this), game_history});
+}
+
 bool GameState::forward_move(void) {
-    if (game_history.size() > m_movenum + 1) {
-        m_movenum++;
-        *(static_cast<KoState*>(this)) = *game_history[m_movenum];
+    if (!m_redo.empty()) {
+        game_history = std::move(m_redo.back());
+        m_redo.pop_back();
+        *(static_cast<KoState*>(this)) = *game_history->state;
         return true;
     } else {
         return false;
@@ -66,15 +74,12 @@ bool GameState::forward_move(void) {
 
 bool GameState::undo_move(void) {
     if (m_movenum > 0) {
-        m_movenum--;
-
         // don't actually delete it!
-        //game_history.pop_back();
-
-        // this is not so nice, but it should work
-        *(static_cast<KoState*>(this)) = *game_history[m_movenum];
+        m_redo.emplace_back(game_history);
+        game_history = game_history->prev;
 
         // This also restores hashes as they're part of state
+        *(static_cast<KoState*>(this)) = *game_history->state;
         return true;
     } else {
         return false;
@@ -82,8 +87,20 @@ bool GameState::undo_move(void) {
 }
 
 void GameState::rewind(void) {
-    *(static_cast<KoState*>(this)) = *game_history[0];
-    m_movenum = 0;
+    while (game_history->prev) {
+        m_redo.emplace_back(game_history);
+        game_history = game_history->prev;
+    }
+    *(static_cast<KoState*>(this)) = *game_history->state;
+}
+
+const KoState & GameState::get_past_state(size_t movesago) const {
+    assert(movesago <= m_movenum);
+    auto node = game_history.get();
+    while (movesago--) {
+        node = node->prev.get();
+    }
+    return *node->state;
 }
 
 void GameState::play_move(int vertex) {
@@ -108,8 +125,8 @@ void GameState::play_move(int color, int vertex) {
     }
 
     // cut off any leftover moves from navigating
-    game_history.resize(m_movenum);
-    game_history.emplace_back(std::make_shared<KoState>(*this));
+    m_redo.clear();
+    push_game_history();
 }
 
 bool GameState::play_textmove(std::string color, std::string vertex) {
@@ -196,8 +213,9 @@ void GameState::adjust_time(int color, int time, int stones) {
 void GameState::anchor_game_history(void) {
     // handicap moves don't count in game history
     m_movenum = 0;
-    game_history.clear();
-    game_history.emplace_back(std::make_shared<KoState>(*this));
+    game_history.reset();
+    m_redo.clear();
+    push_game_history();
 }
 
 bool GameState::set_fixed_handicap(int handicap) {
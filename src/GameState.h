@@ -46,6 +46,7 @@ public:
     void rewind(void); /* undo infinite */
     bool undo_move(void);
     bool forward_move(void);
+    const KoState & get_past_state(size_t movesago) const;
 
     void play_move(int color, int vertex);
     void play_move(int vertex);
@@ -65,7 +66,17 @@ public:
 private:
     bool valid_handicap(int stones);
 
-    std::vector<std::shared_ptr<KoState>> game_history;
+    // Snapshots of the game so far, newest first. Nodes are immutable
+    // and shared between copies, undo only moves the head.
+    struct HistoryNode {
+        std::shared_ptr<const KoState> state;
+        std::shared_ptr<const HistoryNode> prev;
+    };
+    void push_game_history();
+
+    std::shared_ptr<const HistoryNode> game_history;
+    // Positions undone, most recent undo last, for forward_move.
+    std::vector<std::shared_ptr<const HistoryNode>> m_redo;
     TimeControl m_timecontrol;
 };
 
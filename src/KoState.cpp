@@ -33,46 +33,84 @@ void KoState::init_game(int size, float komi) {
 
     FastState::init_game(size, komi);
 
-    m_ko_hash_history.clear();
-    m_hash_history.clear();
+    m_history.reset();
+    m_ko_hash_filter.fill(0);
 
-    m_ko_hash_history.emplace_back(board.calc_ko_hash());
-    m_hash_history.emplace_back(board.calc_hash());
+    board.calc_ko_hash();
+    board.calc_hash();
+    push_history();
+}
+
+bool KoState::filter_test(uint64 hash) const {
+    for (int i = 0; i < FILTER_PROBES; i++) {
+        auto bit = (hash >> (i * 16)) % FILTER_BITS;
+        if (!(m_ko_hash_filter[bit / 64] & (uint64{1} << (bit % 64)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void KoState::push_history() {
+    // The previous position now becomes part of the history proper.
+    if (m_history) {
+        auto prev = m_history->ko_hash;
+        for (int i = 0; i < FILTER_PROBES; i++) {
+            auto bit = (prev >> (i * 16)) % FILTER_BITS;
+            m_ko_hash_filter[bit / 64] |= uint64{1} << (bit % 64);
+        }
+    }
+    m_history = std::make_shared<const HashHistory>(
+        HashHistory{board.get_ko_hash(), board.get_hash(), m_history});
 }
 
 bool KoState::superko(void) const {
-    auto first = crbegin(m_ko_hash_history);
-    auto last = crend(m_ko_hash_history);
+    auto hash = board.get_ko_hash();
+    if (!filter_test(hash)) {
+        return false;
+    }
 
-    auto res = std::find(++first, last, board.get_ko_hash());
+    for (auto node = m_history->prev.get(); node; node = node->prev.get()) {
+        if (node->ko_hash == hash) {
+            return true;
+        }
+    }
 
-    return (res != last);
+    return false;
 }
 
 bool KoState::superko(uint64 newhash) const {
-    auto first = crbegin(m_ko_hash_history);
-    auto last = crend(m_ko_hash_history);
+    if (!m_history) {
+        return false;
+    }
+    if (!filter_test(newhash) && newhash != m_history->ko_hash) {
+        return false;
+    }
 
-    auto res = std::find(first, last, newhash);
+    for (auto node = m_history.get(); node; node = node->prev.get()) {
+        if (node->ko_hash == newhash) {
+            return true;
+        }
+    }
 
-    return (res != last);
+    return false;
 }
 
 void KoState::reset_game() {
     FastState::reset_game();
 
-    m_ko_hash_history.clear();
-    m_hash_history.clear();
+    m_history.reset();
+    m_ko_hash_filter.fill(0);
 
-    m_ko_hash_history.push_back(board.calc_ko_hash());
-    m_hash_history.push_back(board.calc_hash());
+    board.calc_ko_hash();
+    board.calc_hash();
+    push_history();
 }
 
 void KoState::play_pass(void) {
     FastState::play_pass();
 
-    m_ko_hash_history.push_back(board.get_ko_hash());
-    m_hash_history.push_back(board.get_hash());
+    push_history();
 }
 
 void KoState::play_move(int vertex) {
@@ -83,8 +121,7 @@ void KoState::play_move(int color, int vertex) {
     if (vertex != FastBoard::PASS && vertex != FastBoard::RESIGN) {
         FastState::play_move(color, vertex);
 
-        m_ko_hash_history.push_back(board.get_ko_hash());
-        m_hash_history.push_back(board.get_hash());
+        push_history();
     } else {
         play_pass();
     }
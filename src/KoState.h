@@ -19,7 +19,8 @@
 #ifndef KOSTATE_H_INCLUDED
 #define KOSTATE_H_INCLUDED
 
-#include <vector>
+#include <array>
+#include <memory>
 
 #include "FastState.h"
 #include "FullBoard.h"
@@ -36,8 +37,24 @@ public:
     void play_move(int vertex);
 
 private:
-    std::vector<uint64> m_ko_hash_history;
-    std::vector<uint64> m_hash_history;
+    // Bloom filter over every ko hash in the history except the most
+    // recent one, so superko() can reject in constant time before
+    // falling back to the exact scan.
+    static constexpr int FILTER_BITS = 4096;
+    static constexpr int FILTER_PROBES = 3;
+    std::array<uint64, FILTER_BITS / 64> m_ko_hash_filter{};
+
+    bool filter_test(uint64 hash) const;
+    void push_history();
+
+    // Hashes of every position so far, newest first. Entries are never
+    // modified, so copies of a state share everything but the head.
+    struct HashHistory {
+        uint64 ko_hash;
+        uint64 hash;
+        std::shared_ptr<const HashHistory> prev;
+    };
+    std::shared_ptr<const HashHistory> m_history;
 };
 
 #endif
@@ -18,6 +18,7 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
@@ -25,13 +26,16 @@
 #include <boost/program_options.hpp>
 #include <boost/format.hpp>
 #include "Network.h"
+#include "Benchmark.h"
 
 #include "Zobrist.h"
 #include "GTP.h"
 #include "SMP.h"
 #include "Random.h"
+#include "RootParallel.h"
 #include "Utils.h"
 #include "ThreadPool.h"
+#include "UCTNode.h"
 
 using namespace Utils;
 
@@ -44,7 +48,9 @@ static void license_blurb() {
     );
 }
 
-static void parse_commandline(int argc, char *argv[], bool & gtp_mode) {
+static void parse_commandline(int argc, char *argv[], bool & gtp_mode,
+                              bool & benchmark_mode,
+                              std::string & worker_socket) {
     namespace po = boost::program_options;
     // Declare the supported options.
     po::options_description v_desc("Allowed options");
@@ -54,9 +60,25 @@ static void parse_commandline(int argc, char *argv[], bool & gtp_mode) {
         ("threads,t", po::value<int>()->default_value
                       (std::min(2, cfg_num_threads)),
                       "Number of threads to use.")
+        ("inflight", po::value<int>(),
+                     "Simulations each thread keeps waiting on the "
+                     "network. Above 1, evaluations run on separate "
+                     "threads.")
+        ("nnthreads", po::value<int>()->default_value(cfg_nn_threads),
+                      "Number of network evaluation threads with --inflight.")
+        ("coordinator", po::value<std::string>(),
+                        "Let root parallel workers join our searches "
+                        "through this Unix socket.")
+        ("worker", po::value<std::string>(),
+                   "Search for the coordinator listening on this Unix "
+                   "socket instead of playing.")
+        ("affinity", "Pin search and evaluation threads to CPUs, "
+                     "filling one NUMA node at a time.")
         ("playouts,p", po::value<int>(),
                        "Weaken engine by limiting the number of playouts. "
                        "Requires --noponder.")
+        ("maxtreememory", po::value<int>(),
+                          "Memory budget for the search tree in MiB.")
         ("lagbuffer,b", po::value<int>()->default_value(cfg_lagbuffer_cs),
                         "Safety margin for time usage in centiseconds.")
         ("resignpct,r", po::value<int>()->default_value(cfg_resignpct),
@@ -66,11 +88,19 @@ static void parse_commandline(int argc, char *argv[], bool & gtp_mode) {
         ("noise,n", "Enable policy network randomization.")
         ("seed,s", po::value<uint64>(),
                    "Random number generation seed.")
+        ("deterministic", "Search in fixed batches, so that runs with the "
+                          "same seed, threads and playouts build the same "
+                          "tree.")
         ("dumbpass,d", "Don't use heuristics for smarter passing.")
+        ("nosmartstop", "Don't stop searching when the best move "
+                        "can no longer change. Searches limited by "
+                        "playouts never stop early.")
         ("weights,w", po::value<std::string>(), "File with network weights.")
         ("logfile,l", po::value<std::string>(), "File to log input/output to.")
         ("quiet,q", "Disable all diagnostic output.")
         ("noponder", "Disable thinking on opponent's time.")
+        ("benchmark", "Test search speed on fixed positions and exit. "
+                      "Uses --playouts per search and up to --threads threads.")
 #ifdef USE_OPENCL
         ("gpu",  po::value<std::vector<int> >(),
                 "ID of the OpenCL device(s) to use (disables autodetection).")
@@ -160,9 +190,33 @@ static void parse_commandline(int argc, char *argv[], bool & gtp_mode) {
         }
     }
 
+    if (vm.count("inflight")) {
+        cfg_sims_per_thread = std::max(1, std::min(vm["inflight"].as<int>(),
+            UCTNode::MAX_CONCURRENT_SIMS / cfg_num_threads));
+    }
+
+    if (vm.count("nnthreads")) {
+        cfg_nn_threads = std::max(1,
+            std::min(vm["nnthreads"].as<int>(), MAX_BLAS_THREADS));
+    }
+
+    // The search threads hand their evaluations to the evaluation
+    // threads, give them as many as BLAS allows.
+    if (cfg_num_threads > MAX_BLAS_THREADS && vm["nnthreads"].defaulted()) {
+        cfg_nn_threads = MAX_BLAS_THREADS;
+    }
+
+    if (vm.count("affinity")) {
+        cfg_affinity = true;
+    }
+
+    if (vm.count("deterministic")) {
+        cfg_deterministic = true;
+    }
+
     if (vm.count("seed")) {
         cfg_rng_seed = vm["seed"].as<uint64>();
-        if (cfg_num_threads > 1) {
+        if (cfg_num_threads > 1 && !cfg_deterministic) {
             myprintf("Seed specified but multiple threads enabled.\n");
             myprintf("Games will likely not be reproducible.\n");
         }
@@ -181,9 +235,30 @@ static void parse_commandline(int argc, char *argv[], bool & gtp_mode) {
         cfg_dumbpass = true;
     }
 
+    if (vm.count("nosmartstop")) {
+        cfg_smart_stop = false;
+    }
+
+    if (vm.count("benchmark")) {
+        benchmark_mode = true;
+        cfg_allow_pondering = false;
+        cfg_max_playouts = Benchmark::DEFAULT_PLAYOUTS;
+    }
+
+    if (vm.count("coordinator")) {
+        if (!RootParallel::listen(vm["coordinator"].as<std::string>())) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (vm.count("worker")) {
+        worker_socket = vm["worker"].as<std::string>();
+        cfg_allow_pondering = false;
+    }
+
     if (vm.count("playouts")) {
         cfg_max_playouts = vm["playouts"].as<int>();
-        if (!vm.count("noponder")) {
+        if (!vm.count("noponder") && !benchmark_mode) {
             myprintf("Nonsensical options: Playouts are restricted but "
                      "thinking on the opponent's time is still allowed. "
                      "Add --noponder if you want a weakened engine.\n");
@@ -191,6 +266,12 @@ static void parse_commandline(int argc, char *argv[], bool & gtp_mode) {
         }
     }
 
+    if (vm.count("maxtreememory")) {
+        auto mib = std::max(1, vm["maxtreememory"].as<int>());
+        cfg_max_tree_memory = size_t(mib) * 1024 * 1024;
+        myprintf("Using up to %d MiB for the search tree.\n", mib);
+    }
+
     if (vm.count("resignpct")) {
         cfg_resignpct = vm["resignpct"].as<int>();
     }
@@ -226,11 +307,13 @@ static void parse_commandline(int argc, char *argv[], bool & gtp_mode) {
 
 int main (int argc, char *argv[]) {
     bool gtp_mode = false;
+    bool benchmark_mode = false;
+    std::string worker_socket;
     std::string input;
 
     // Set up engine parameters
     GTP::setup_default_parameters();
-    parse_commandline(argc, argv, gtp_mode);
+    parse_commandline(argc, argv, gtp_mode, benchmark_mode, worker_socket);
 
     // Disable IO buffering as much as possible
     std::cout.setf(std::ios::unitbuf);
@@ -247,7 +330,19 @@ int main (int argc, char *argv[]) {
         license_blurb();
     }
 
-    thread_pool.initialize(cfg_num_threads);
+    if (cfg_affinity) {
+        myprintf("%s", SMP::describe_topology().c_str());
+        for (auto i = 0; i < cfg_num_threads; i++) {
+            auto cpu = SMP::cpu_for_thread(i);
+            myprintf("Search thread %d: CPU %d, node %d\n",
+                     i, cpu, SMP::node_of_cpu(cpu));
+        }
+        thread_pool.initialize(cfg_num_threads, [](size_t index) {
+            SMP::pin_thread(SMP::cpu_for_thread(index));
+        });
+    } else {
+        thread_pool.initialize(cfg_num_threads);
+    }
 
     // Use deterministic random numbers for hashing
     auto rng = std::make_unique<Random>(5489);
@@ -261,19 +356,30 @@ int main (int argc, char *argv[]) {
     // Initialize network
     Network::initialize();
 
+    if (benchmark_mode) {
+        Benchmark::run(cfg_max_playouts);
+        return 0;
+    }
+
+    if (!worker_socket.empty()) {
+        return RootParallel::run_worker(worker_socket);
+    }
+
     auto maingame = std::make_unique<GameState>();
 
     /* set board limits */
     float komi = 7.5;
     maingame->init_game(19, komi);
 
+    Utils::start_input_reader();
+
     for(;;) {
         if (!gtp_mode) {
             maingame->display_state();
             std::cout << "Leela: ";
         }
 
-        if (std::getline(std::cin, input)) {
+        if (Utils::read_input(input)) {
             Utils::log_input(input);
             GTP::execute(*maingame, input);
         } else {
@@ -52,6 +52,8 @@
 #include "Random.h"
 #include "Network.h"
 #include "GTP.h"
+#include "SMP.h"
+#include "SearchStats.h"
 #include "Utils.h"
 
 using namespace Utils;
@@ -83,6 +85,26 @@ static std::array<float, 256> ip1_val_b;
 static std::array<float, 256> ip2_val_w;
 static std::array<float, 1> ip2_val_b;
 
+// Runs get_scored_moves_async() requests.
+static ThreadPool eval_pool;
+static thread_local bool on_eval_thread = false;
+
+/*
+    The evaluation threads are the only ones that need to call into
+    BLAS once there are more search threads than the library allows
+    (see MAX_BLAS_THREADS). Each keeps its BLAS calls single threaded.
+*/
+static void start_eval_thread(size_t index) {
+    on_eval_thread = true;
+#if defined(USE_BLAS) && defined(USE_MKL)
+    mkl_set_num_threads_local(1);
+#endif
+    if (cfg_affinity) {
+        // Evaluation threads go on the CPUs after the search threads.
+        SMP::pin_thread(SMP::cpu_for_thread(cfg_num_threads + index));
+    }
+}
+
 void Network::benchmark(GameState * state, int iterations) {
     int cpus = cfg_num_threads;
     int iters_per_thread = (iterations + (cpus - 1)) / cpus;
@@ -90,14 +112,12 @@ void Network::benchmark(GameState * state, int iterations) {
     Time start;
 
     ThreadGroup tg(thread_pool);
-    for (int i = 0; i < cpus; i++) {
-        tg.add_task([iters_per_thread, state]() {
-            GameState mystate = *state;
-            for (int loop = 0; loop < iters_per_thread; loop++) {
-                auto vec = get_scored_moves(&mystate, Ensemble::RANDOM_ROTATION);
-            }
-        });
-    };
+    tg.add_tasks(cpus, [iters_per_thread, state]() {
+        GameState mystate = *state;
+        for (int loop = 0; loop < iters_per_thread; loop++) {
+            auto vec = get_scored_moves(&mystate, Ensemble::RANDOM_ROTATION);
+        }
+    });
     tg.wait_all();
 
     Time end;
@@ -250,6 +270,17 @@ void Network::initialize(void) {
 #endif
 #endif
 #endif
+    if (cfg_sims_per_thread > 1 || cfg_num_threads > MAX_BLAS_THREADS) {
+        myprintf("Using %d evaluation thread(s).\n", cfg_nn_threads);
+        if (cfg_affinity) {
+            for (auto i = 0; i < cfg_nn_threads; i++) {
+                auto cpu = SMP::cpu_for_thread(cfg_num_threads + i);
+                myprintf("Evaluation thread %d: CPU %d, node %d\n",
+                         i, cpu, SMP::node_of_cpu(cpu));
+            }
+        }
+        eval_pool.initialize(cfg_nn_threads, start_eval_thread);
+    }
 }
 
 #ifdef USE_BLAS
@@ -375,6 +406,10 @@ void Network::softmax(const std::vector<float>& input,
 
 Network::Netresult Network::get_scored_moves(
     GameState * state, Ensemble ensemble, int rotation) {
+    if (cfg_num_threads > MAX_BLAS_THREADS && !on_eval_thread) {
+        return get_scored_moves_async(state, ensemble, rotation).get();
+    }
+
     Netresult result;
     if (state->board.get_boardsize() != 19) {
         return result;
@@ -396,6 +431,14 @@ Network::Netresult Network::get_scored_moves(
     return result;
 }
 
+std::future<Network::Netresult> Network::get_scored_moves_async(
+    GameState * state, Ensemble ensemble, int rotation) {
+    return eval_pool.add_task([state, ensemble, rotation]() {
+        SearchStats::Timer timer(SearchStats::NN_EVAL);
+        return get_scored_moves(state, ensemble, rotation);
+    });
+}
+
 Network::Netresult Network::get_scored_moves_internal(
     GameState * state, NNPlanes & planes, int rotation) {
     assert(rotation >= 0 && rotation <= 7);
@@ -536,14 +579,15 @@ void Network::gather_features(GameState * state, NNPlanes & planes) {
     }
 
     // Go back in time, fill history boards
-    size_t backtracks = 0;
-    for (int h = 0; h < 8; h++) {
+    auto history = std::min<size_t>(8, state->get_movenum() + 1);
+    for (size_t h = 0; h < history; h++) {
+        const auto& board = h == 0 ? state->board
+                                   : state->get_past_state(h).board;
         // collect white, black occupation planes
         for (int j = 0; j < 19; j++) {
             for(int i = 0; i < 19; i++) {
-                int vtx = state->board.get_vertex(i, j);
-                FastBoard::square_t color =
-                    state->board.get_square(vtx);
+                int vtx = board.get_vertex(i, j);
+                FastBoard::square_t color = board.get_square(vtx);
                 int idx = j * 19 + i;
                 if (color != FastBoard::EMPTY) {
                     if (color == to_move) {
@@ -554,16 +598,6 @@ void Network::gather_features(GameState * state, NNPlanes & planes) {
                 }
             }
         }
-        if (!state->undo_move()) {
-            break;
-        } else {
-            backtracks++;
-        }
-    }
-
-    // Now go back to present day
-    for (size_t h = 0; h < backtracks; h++) {
-        state->forward_move();
     }
 }
 
@@ -25,6 +25,7 @@
 #include <bitset>
 #include <memory>
 #include <array>
+#include <future>
 
 #ifdef USE_OPENCL
 #include <atomic>
@@ -47,6 +48,11 @@ public:
     static Netresult get_scored_moves(GameState * state,
                                       Ensemble ensemble,
                                       int rotation = -1);
+    // Evaluate on one of the evaluation threads. The state must
+    // stay alive and unchanged until the result is ready.
+    static std::future<Netresult> get_scored_moves_async(GameState * state,
+                                                         Ensemble ensemble,
+                                                         int rotation = -1);
     // File format version
     static constexpr int FORMAT_VERSION = 1;
     static constexpr int INPUT_CHANNELS = 18;
@@ -0,0 +1,91 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017 Gian-Carlo Pascutto
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "config.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "Replay.h"
+
+Replay::Replay(const FastState & start) : m_state(start) {
+    push_history();
+}
+
+const FastState & Replay::get_state() const {
+    return m_state;
+}
+
+bool Replay::is_legal(int move) const {
+    if (move == FastBoard::PASS) {
+        return true;
+    }
+    const auto & board = m_state.board;
+    if (move < 0 || move >= FastBoard::MAXSQ
+        || board.get_square(move) != FastBoard::EMPTY
+        || move == m_state.get_komove()) {
+        return false;
+    }
+    auto color = m_state.get_to_move();
+    return board.get_legal_bb(color).test(board.vertex_to_bit(move));
+}
+
+bool Replay::play_move(int move) {
+    if (!is_legal(move)) {
+        return false;
+    }
+    m_state.play_move(move);
+    push_history();
+    return true;
+}
+
+void Replay::push_history() {
+    m_head = (m_head + 1) % HISTORY;
+    m_history[m_head][FastBoard::BLACK] =
+        m_state.board.get_stones_bb(FastBoard::BLACK);
+    m_history[m_head][FastBoard::WHITE] =
+        m_state.board.get_stones_bb(FastBoard::WHITE);
+    m_history_len = std::min(m_history_len + 1, HISTORY);
+}
+
+void Replay::gather_features(Network::NNPlanes & planes) const {
+    assert(m_state.board.get_boardsize() == 19);
+    planes.resize(18);
+    constexpr size_t our_offset   = 0;
+    constexpr size_t their_offset = 8;
+
+    auto to_move = m_state.get_to_move();
+    if (to_move == FastBoard::WHITE) {
+        planes[17].set();
+    } else {
+        planes[16].set();
+    }
+
+    for (int h = 0; h < m_history_len; h++) {
+        const auto & stones = m_history[(m_head - h + HISTORY) % HISTORY];
+        auto & ours = planes[our_offset + h];
+        auto & theirs = planes[their_offset + h];
+        stones[to_move].for_each([&ours](int bit) {
+            ours[(bit / BitBoard::ROW) * 19 + bit % BitBoard::ROW] = true;
+        });
+        stones[!to_move].for_each([&theirs](int bit) {
+            theirs[(bit / BitBoard::ROW) * 19 + bit % BitBoard::ROW] = true;
+        });
+    }
+}
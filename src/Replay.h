@@ -0,0 +1,79 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017 Gian-Carlo Pascutto
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef REPLAY_H_INCLUDED
+#define REPLAY_H_INCLUDED
+
+#include "config.h"
+
+#include <array>
+#include <vector>
+
+#include "BitBoard.h"
+#include "FastState.h"
+#include "Network.h"
+
+/*
+    Plays a recorded game forward without keeping any game history.
+    Only the stones of the last few positions are remembered, which is
+    all the network input needs. Meant for bulk SGF processing, where
+    GameState would allocate a snapshot per move.
+*/
+class Replay {
+public:
+    explicit Replay(const FastState & start);
+
+    const FastState & get_state() const;
+
+    // Legal for the side to move: pass, or a non-suicide, non-ko point.
+    bool is_legal(int move) const;
+
+    // Returns false, leaving the position as it was, for an illegal move.
+    bool play_move(int move);
+
+    // Same planes as Network::gather_features on the equivalent GameState.
+    void gather_features(Network::NNPlanes & planes) const;
+
+    // Plays moves in order. f(replay, move) sees each position before
+    // its move is made. Stops at the first illegal move and returns false.
+    template <class F>
+    bool run(const std::vector<int> & moves, F f) {
+        for (auto move : moves) {
+            if (!is_legal(move)) {
+                return false;
+            }
+            f(*this, move);
+            play_move(move);
+        }
+        return true;
+    }
+
+private:
+    static constexpr int HISTORY = 8;
+
+    void push_history();
+
+    FastState m_state;
+    // Stones per colour of the most recent positions, newest at m_head.
+    std::array<std::array<BitBoard, 2>, HISTORY> m_history;
+    int m_head{0};
+    int m_history_len{0};
+};
+
+#endif
@@ -0,0 +1,453 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017 Gian-Carlo Pascutto
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "config.h"
+#include "RootParallel.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "FastBoard.h"
+#include "SGFTree.h"
+#include "UCTSearch.h"
+#include "Utils.h"
+
+using namespace Utils;
+
+/*
+    The protocol is line based. The coordinator sends
+
+        position <bytes>     followed by an SGF of that many bytes
+        go <b|w> <id>        search with that side to move
+        stop
+
+    and a worker answers with any number of
+
+        stats <id> <count> (<vertex> <visits> <blackevals>)...
+
+    holding totals for the search so far, then "done <id>" after a stop.
+    A worker that misses the stop deadline can still be reporting on an
+    earlier search, the id lets us tell those lines apart.
+*/
+
+#ifndef _WIN32
+
+namespace {
+    // How often workers report, and how long we wait for final reports.
+    constexpr auto REPORT_INTERVAL = std::chrono::milliseconds(100);
+    constexpr auto STOP_TIMEOUT_MS = 1000;
+
+    using MoveStats = std::map<int, std::pair<int, double>>;
+
+    struct Peer {
+        int fd{-1};
+        std::string inbuf;
+        bool searching{false};
+        // What the worker reported, and how much of it we merged.
+        MoveStats reported;
+        MoveStats merged;
+    };
+
+    int s_listen_fd = -1;
+    std::vector<Peer> s_peers;
+    // Id of the current search, sent with go and echoed by the workers.
+    int s_search_id = 0;
+
+    bool send_all(int fd, const std::string & data) {
+        auto sent = size_t{0};
+        while (sent < data.size()) {
+            auto n = send(fd, data.data() + sent, data.size() - sent,
+                          MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    auto pfd = pollfd{fd, POLLOUT, 0};
+                    poll(&pfd, 1, -1);
+                    continue;
+                }
+                return false;
+            }
+            sent += n;
+        }
+        return true;
+    }
+
+    void drop(Peer & peer) {
+        myprintf("Root parallel worker on fd %d disconnected.\n", peer.fd);
+        close(peer.fd);
+        peer.fd = -1;
+        peer.searching = false;
+    }
+
+    void send_to(Peer & peer, const std::string & data) {
+        if (peer.fd >= 0 && !send_all(peer.fd, data)) {
+            drop(peer);
+        }
+    }
+
+    void parse_line(Peer & peer, const std::string & line) {
+        auto ss = std::istringstream{line};
+        auto cmd = std::string{};
+        auto id = 0;
+        ss >> cmd >> id;
+        if (!ss || id != s_search_id) {
+            // Late lines from an earlier search.
+            return;
+        }
+        if (cmd == "stats") {
+            auto count = 0;
+            ss >> count;
+            for (auto i = 0; i < count; i++) {
+                auto vertex = 0;
+                auto visits = 0;
+                auto blackevals = 0.0;
+                if (!(ss >> vertex >> visits >> blackevals)) {
+                    break;
+                }
+                peer.reported[vertex] = {visits, blackevals};
+            }
+        } else if (cmd == "done") {
+            peer.searching = false;
+        }
+    }
+
+    // Read whatever the worker sent without blocking.
+    void receive(Peer & peer) {
+        char buf[4096];
+        while (peer.fd >= 0) {
+            auto n = recv(peer.fd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (n == 0 || (n < 0 && errno != EAGAIN
+                           && errno != EWOULDBLOCK && errno != EINTR)) {
+                drop(peer);
+                break;
+            }
+            if (n < 0) {
+                break;
+            }
+            peer.inbuf.append(buf, n);
+        }
+        size_t eol;
+        while ((eol = peer.inbuf.find('\n')) != std::string::npos) {
+            parse_line(peer, peer.inbuf.substr(0, eol));
+            peer.inbuf.erase(0, eol + 1);
+        }
+    }
+
+    void accept_workers() {
+        for (;;) {
+            auto fd = accept(s_listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                break;
+            }
+            auto peer = Peer{};
+            peer.fd = fd;
+            s_peers.emplace_back(std::move(peer));
+            myprintf("Root parallel worker on fd %d connected.\n", fd);
+        }
+    }
+
+    void remove_dropped() {
+        auto it = std::remove_if(begin(s_peers), end(s_peers),
+                                 [](const Peer & peer) {
+                                     return peer.fd < 0;
+                                 });
+        s_peers.erase(it, end(s_peers));
+    }
+
+    std::string format_stats(int id, UCTNode & root) {
+        auto count = 0;
+        auto moves = std::ostringstream{};
+        moves.precision(17);
+        if (root.has_children()) {
+            for (auto child = root.get_first_child();
+                 child != nullptr; child = child->get_sibling()) {
+                if (child->get_visits() > 0) {
+                    moves << " " << child->get_move()
+                          << " " << child->get_visits()
+                          << " " << child->get_blackevals();
+                    count++;
+                }
+            }
+        }
+        return "stats " + std::to_string(id) + " "
+               + std::to_string(count) + moves.str() + "\n";
+    }
+}
+
+bool RootParallel::listen(const std::string & path) {
+    auto addr = sockaddr_un{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        myprintf("Socket path too long: %s\n", path.c_str());
+        return false;
+    }
+    path.copy(addr.sun_path, path.size());
+
+    s_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str());
+    if (s_listen_fd < 0
+        || bind(s_listen_fd, reinterpret_cast<sockaddr*>(&addr),
+                sizeof(addr)) < 0
+        || ::listen(s_listen_fd, 16) < 0) {
+        myprintf("Can't listen on %s\n", path.c_str());
+        return false;
+    }
+    fcntl(s_listen_fd, F_SETFL, fcntl(s_listen_fd, F_GETFL) | O_NONBLOCK);
+    myprintf("Waiting for root parallel workers on %s\n", path.c_str());
+    return true;
+}
+
+int RootParallel::num_workers() {
+    return static_cast<int>(s_peers.size());
+}
+
+void RootParallel::start_search(GameState & state) {
+    if (s_listen_fd < 0) {
+        return;
+    }
+    accept_workers();
+
+    auto sgf = SGFTree::state_to_string(state, state.get_to_move());
+    auto color = state.get_to_move() == FastBoard::WHITE ? "w" : "b";
+    s_search_id++;
+    auto msg = "position " + std::to_string(sgf.size()) + "\n" + sgf
+               + "go " + color + " " + std::to_string(s_search_id) + "\n";
+    for (auto & peer : s_peers) {
+        peer.reported.clear();
+        peer.merged.clear();
+        peer.searching = true;
+        send_to(peer, msg);
+    }
+    remove_dropped();
+}
+
+void RootParallel::merge(UCTNode & root) {
+    if (s_listen_fd < 0) {
+        return;
+    }
+    for (auto & peer : s_peers) {
+        receive(peer);
+    }
+    if (!root.has_children()) {
+        return;
+    }
+
+    auto total_visits = 0;
+    auto total_evals = 0.0;
+    for (auto child = root.get_first_child();
+         child != nullptr; child = child->get_sibling()) {
+        for (auto & peer : s_peers) {
+            auto it = peer.reported.find(child->get_move());
+            if (it == end(peer.reported)) {
+                continue;
+            }
+            auto & merged = peer.merged[child->get_move()];
+            auto visits = it->second.first - merged.first;
+            auto evals = it->second.second - merged.second;
+            if (visits > 0) {
+                child->merge(visits, evals);
+                total_visits += visits;
+                total_evals += evals;
+                merged = it->second;
+            }
+        }
+    }
+    root.merge(total_visits, total_evals);
+}
+
+void RootParallel::stop_search(UCTNode & root) {
+    if (s_listen_fd < 0) {
+        return;
+    }
+    for (auto & peer : s_peers) {
+        if (peer.searching) {
+            send_to(peer, "stop\n");
+        }
+    }
+
+    // Wait a little for the final reports.
+    auto deadline = std::chrono::steady_clock::now()
+                    + std::chrono::milliseconds(STOP_TIMEOUT_MS);
+    for (;;) {
+        auto fds = std::vector<pollfd>{};
+        for (auto & peer : s_peers) {
+            if (peer.searching) {
+                fds.push_back({peer.fd, POLLIN, 0});
+            }
+        }
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (fds.empty() || left <= 0) {
+            break;
+        }
+        poll(fds.data(), fds.size(), left);
+        for (auto & peer : s_peers) {
+            if (peer.searching) {
+                receive(peer);
+            }
+        }
+    }
+    merge(root);
+    remove_dropped();
+}
+
+int RootParallel::run_worker(const std::string & path) {
+    auto addr = sockaddr_un{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        myprintf("Socket path too long: %s\n", path.c_str());
+        return EXIT_FAILURE;
+    }
+    path.copy(addr.sun_path, path.size());
+
+    auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr),
+                          sizeof(addr)) < 0) {
+        myprintf("Can't connect to coordinator at %s\n", path.c_str());
+        return EXIT_FAILURE;
+    }
+    myprintf("Connected to coordinator at %s\n", path.c_str());
+
+    auto game = GameState{};
+    game.init_game(19, 7.5f);
+    std::unique_ptr<UCTSearch> search;
+    std::future<void> searching;
+    auto search_id = 0;
+
+    auto stop_searching = [&]() {
+        if (!searching.valid()) {
+            return;
+        }
+        // The search may not have started yet, so keep asking.
+        do {
+            search->stop();
+        } while (searching.wait_for(std::chrono::milliseconds(10))
+                 != std::future_status::ready);
+        searching.get();
+        send_all(fd, "done " + std::to_string(search_id) + "\n");
+    };
+
+    auto inbuf = std::string{};
+    // Read exactly len bytes, or up to the next newline if len is 0.
+    auto read_input = [&](std::string & out, size_t len) {
+        for (;;) {
+            auto eol = inbuf.find('\n');
+            if (len == 0 && eol != std::string::npos) {
+                out = inbuf.substr(0, eol);
+                inbuf.erase(0, eol + 1);
+                return true;
+            }
+            if (len > 0 && inbuf.size() >= len) {
+                out = inbuf.substr(0, len);
+                inbuf.erase(0, len);
+                return true;
+            }
+            char buf[4096];
+            auto n = recv(fd, buf, sizeof(buf), 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            inbuf.append(buf, n);
+        }
+    };
+
+    auto line = std::string{};
+    while (read_input(line, 0)) {
+        auto ss = std::istringstream{line};
+        auto cmd = std::string{};
+        ss >> cmd;
+        if (cmd == "position") {
+            auto len = size_t{0};
+            ss >> len;
+            auto sgf = std::string{};
+            if (!read_input(sgf, len)) {
+                break;
+            }
+            stop_searching();
+            auto tree = SGFTree{};
+            tree.load_from_string(sgf);
+            game = tree.follow_mainline_state();
+        } else if (cmd == "go") {
+            auto color = std::string{};
+            auto id = 0;
+            ss >> color >> id;
+            stop_searching();
+            search_id = id;
+            game.board.set_to_move(color == "w" ? FastBoard::WHITE
+                                                : FastBoard::BLACK);
+            // A fresh tree, so the totals we report are all new work.
+            search = std::make_unique<UCTSearch>(game);
+            searching = std::async(std::launch::async, [&, id]() {
+                search->search_until_stopped(REPORT_INTERVAL,
+                    [fd, id](UCTNode & root) {
+                        send_all(fd, format_stats(id, root));
+                    });
+            });
+        } else if (cmd == "stop") {
+            stop_searching();
+        }
+    }
+
+    stop_searching();
+    close(fd);
+    return EXIT_SUCCESS;
+}
+
+#else
+
+bool RootParallel::listen(const std::string &) {
+    myprintf("Root parallel search needs Unix sockets.\n");
+    return false;
+}
+
+int RootParallel::num_workers() {
+    return 0;
+}
+
+void RootParallel::start_search(GameState &) {}
+void RootParallel::merge(UCTNode &) {}
+void RootParallel::stop_search(UCTNode &) {}
+
+int RootParallel::run_worker(const std::string &) {
+    myprintf("Root parallel search needs Unix sockets.\n");
+    return EXIT_FAILURE;
+}
+
+#endif
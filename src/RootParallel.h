@@ -0,0 +1,52 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017 Gian-Carlo Pascutto
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ROOTPARALLEL_H_INCLUDED
+#define ROOTPARALLEL_H_INCLUDED
+
+#include "config.h"
+
+#include <string>
+
+#include "GameState.h"
+#include "UCTNode.h"
+
+/*
+    Root parallel search over local sockets. Worker processes search
+    the coordinator's root position with their own trees, and report
+    the visits and evals of the root children as they go. The
+    coordinator adds what is new to its own root children.
+
+    The coordinator side functions do nothing unless listen() was
+    called, and are only called from the thread running the search.
+*/
+namespace RootParallel {
+    // Coordinator: accept workers on a Unix socket at path.
+    bool listen(const std::string & path);
+    int num_workers();
+    void start_search(GameState & state);
+    void merge(UCTNode & root);
+    void stop_search(UCTNode & root);
+
+    // Worker: serve searches for the coordinator at path until it
+    // closes the connection.
+    int run_worker(const std::string & path);
+}
+
+#endif
@@ -21,9 +21,19 @@
 #include <fstream>
 #include <iomanip>
 #include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
 #include <string>
 #include <memory>
 #include <stdexcept>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "Utils.h"
 #include "SGFParser.h"
@@ -88,22 +98,285 @@ std::vector<std::string> SGFParser::chop_stream(std::istream& ins,
 
 std::vector<std::string> SGFParser::chop_all(std::string filename,
                                              size_t stopat) {
-    std::ifstream ins(filename.c_str(), std::ifstream::binary | std::ifstream::in);
+    SGFFile file(filename);
+
+    auto count = std::min(file.size(), stopat == SIZE_MAX ? stopat : stopat + 1);
+    std::vector<std::string> result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        result.emplace_back(file.game(i).to_string());
+    }
+
+    return result;
+}
+
+// extract the game with number index, using the offset index
+std::string SGFParser::chop_from_file(std::string filename, size_t index) {
+    SGFFile file(filename);
+
+    if (index >= file.size()) {
+        throw std::runtime_error("Game index out of range");
+    }
+
+    return file.game(index).to_string();
+}
+
+namespace {
+    constexpr auto ONES = uint64{0x0101010101010101ULL};
+    constexpr auto HIGHS = uint64{0x8080808080808080ULL};
+    constexpr char INDEX_MAGIC[8] = {'L', 'Z', 'S', 'G', 'F', 'I', 'X', '2'};
+
+    // Flags bytes of word equal to c. Never misses a match, and a word
+    // without any match gives 0.
+    uint64 match_byte(uint64 word, unsigned char c) {
+        auto x = word ^ (ONES * c);
+        return (x - ONES) & ~x & HIGHS;
+    }
+
+    bool is_special(char c, bool intag) {
+        if (c == ']' || c == '\\') {
+            return true;
+        }
+        return !intag && (c == '(' || c == ')' || c == '[');
+    }
+
+    // Next character that can change the chopper state, checking eight
+    // bytes at a time. Inside a tag only ']' and escapes matter.
+    const char * next_special(const char * p, const char * end, bool intag) {
+        while (end - p >= 8) {
+            uint64 word;
+            std::memcpy(&word, p, sizeof(word));
+            auto hits = match_byte(word, ']') | match_byte(word, '\\');
+            if (!intag) {
+                hits |= match_byte(word, '(') | match_byte(word, ')')
+                      | match_byte(word, '[');
+            }
+            if (hits) {
+                break;
+            }
+            p += 8;
+        }
+        while (p < end && !is_special(*p, intag)) {
+            p++;
+        }
+        return p;
+    }
+}
+
+// Same state machine as chop_stream, but only records where games are.
+SGFFile::GameList SGFFile::scan(boost::string_ref data) {
+    GameList result;
+
+    const auto begin = data.data();
+    const auto end = begin + data.size();
+    auto start = begin;   // first character of the current game
+
+    int nesting = 0;      // parentheses
+    bool intag = false;   // brackets
+
+    auto p = next_special(begin, end, intag);
+    while (p < end) {
+        auto c = *p;
+        if (c == '\\') {
+            // Skip the literal char
+            p = std::min(p + 2, end);
+            p = next_special(p, end, intag);
+            continue;
+        }
+
+        if (c == '(' && !intag) {
+            if (nesting == 0) {
+                // eat ; too
+                do {
+                    p++;
+                } while (p < end
+                         && std::isspace(static_cast<unsigned char>(*p)));
+                start = std::min(p + 1, end);
+            }
+            nesting++;
+        } else if (c == ')' && !intag) {
+            nesting--;
+
+            if (nesting == 0) {
+                result.emplace_back(start - begin, p + 1 - start);
+            }
+        } else if (c == '[' && !intag) {
+            intag = true;
+        } else if (c == ']') {
+            if (intag == false) {
+                auto line = std::count(begin, p, '\n');
+                Utils::myprintf("Tag error on line %d", int(line));
+            }
+            intag = false;
+        }
+        p = next_special(std::min(p + 1, end), end, intag);
+    }
+
+    // No game found? Assume closing tag was missing (OGS)
+    if (result.empty()) {
+        result.emplace_back(start - begin, end - start);
+    }
+
+    return result;
+}
+
+// Modification time in nanoseconds where the platform has it, so a
+// rewrite within the same second still invalidates the index.
+static uint64 modification_time(const struct stat & st) {
+#if defined(__APPLE__)
+    return uint64(st.st_mtimespec.tv_sec) * 1000000000
+           + uint64(st.st_mtimespec.tv_nsec);
+#elif !defined(_WIN32)
+    return uint64(st.st_mtim.tv_sec) * 1000000000
+           + uint64(st.st_mtim.tv_nsec);
+#else
+    return uint64(st.st_mtime) * 1000000000;
+#endif
+}
 
+SGFFile::SGFFile(const std::string & filename, bool write_index) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        throw std::runtime_error("Error opening file");
+    }
+    auto mtime = modification_time(st);
+
+#ifndef _WIN32
+    auto fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Error opening file");
+    }
+    m_size = size_t(st.st_size);
+    if (m_size > 0) {
+        auto map = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Error mapping file");
+        }
+        m_data = static_cast<const char*>(map);
+        m_mapped = true;
+    }
+    close(fd);
+#else
+    std::ifstream ins(filename.c_str(), std::ifstream::binary | std::ifstream::in);
     if (ins.fail()) {
         throw std::runtime_error("Error opening file");
     }
+    m_buffer.assign(std::istreambuf_iterator<char>(ins),
+                    std::istreambuf_iterator<char>());
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+#endif
+
+    auto idxname = filename + ".idx";
+    if (!load_index(idxname, mtime)) {
+        m_games = scan(boost::string_ref(m_data, m_size));
+        // Single games are cheap to rescan, only keep an index
+        // around for collections.
+        if (write_index && m_games.size() > 1) {
+            save_index(idxname, mtime);
+        }
+    }
+}
 
-    auto result = chop_stream(ins, stopat);
-    ins.close();
+SGFFile::~SGFFile() {
+#ifndef _WIN32
+    if (m_mapped) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+#endif
+}
 
-    return result;
+size_t SGFFile::size() const {
+    return m_games.size();
 }
 
-// scan the file and extract the game with number index
-std::string SGFParser::chop_from_file(std::string filename, size_t index) {
-    auto vec = chop_all(filename, index);
-    return vec[index];
+boost::string_ref SGFFile::game(size_t index) const {
+    assert(index < m_games.size());
+    return boost::string_ref(m_data + m_games[index].first,
+                             m_games[index].second);
+}
+
+/*
+    The index is the magic, the size and modification time (in
+    nanoseconds) of the SGF file it belongs to, the number of games, then an offset and length
+    per game. All native endian, it is only a cache.
+*/
+bool SGFFile::load_index(const std::string & idxname, uint64 mtime) {
+    std::ifstream ins(idxname.c_str(), std::ifstream::binary | std::ifstream::in);
+    if (ins.fail()) {
+        return false;
+    }
+
+    char magic[sizeof(INDEX_MAGIC)];
+    uint64 size, time, count;
+    ins.read(magic, sizeof(magic));
+    ins.read(reinterpret_cast<char*>(&size), sizeof(size));
+    ins.read(reinterpret_cast<char*>(&time), sizeof(time));
+    ins.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (ins.fail()
+        || std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0
+        || size != m_size || time != mtime
+        || count > m_size + 1) {
+        return false;
+    }
+
+    auto games = GameList(count);
+    ins.read(reinterpret_cast<char*>(games.data()),
+             count * sizeof(GameList::value_type));
+    if (ins.fail()) {
+        return false;
+    }
+    for (const auto& game : games) {
+        if (game.first > m_size || game.second > m_size - game.first) {
+            return false;
+        }
+    }
+
+    m_games = std::move(games);
+    return true;
+}
+
+void SGFFile::save_index(const std::string & idxname, uint64 mtime) const {
+    // Write to a private file and rename it into place, so nobody
+    // reading the index sees it half written.
+#ifndef _WIN32
+    auto tmpname = idxname + ".tmp" + std::to_string(getpid());
+#else
+    auto tmpname = idxname + ".tmp";
+#endif
+    {
+        std::ofstream out(tmpname.c_str(),
+                          std::ofstream::binary | std::ofstream::out);
+        if (out.fail()) {
+            // Read-only location, just rescan next time.
+            return;
+        }
+
+        auto size = uint64(m_size);
+        auto count = uint64(m_games.size());
+        out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        out.write(reinterpret_cast<const char*>(&mtime), sizeof(mtime));
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        out.write(reinterpret_cast<const char*>(m_games.data()),
+                  m_games.size() * sizeof(GameList::value_type));
+        out.close();
+        if (out.fail()) {
+            std::remove(tmpname.c_str());
+            return;
+        }
+    }
+#ifdef _WIN32
+    // rename() won't replace an existing file here.
+    std::remove(idxname.c_str());
+#endif
+    if (std::rename(tmpname.c_str(), idxname.c_str()) != 0) {
+        std::remove(tmpname.c_str());
+        return;
+    }
+    Utils::myprintf("Wrote index of %d games to %s.\n",
+                    static_cast<int>(m_games.size()), idxname.c_str());
 }
 
 std::string SGFParser::parse_property_name(std::istringstream & strm) {
@@ -22,9 +22,45 @@
 #include <string>
 #include <sstream>
 #include <climits>
+#include <utility>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
 
 #include "SGFTree.h"
 
+/*
+    Read-only view of a (possibly huge) SGF collection. The file is
+    memory mapped and the games are returned as views into it, in the
+    same form chop_stream produces. Game offsets can be cached in
+    "<file>.idx", so opening the file again does not need a rescan.
+    An existing index is always used if it is still valid, but only
+    written when write_index is set.
+*/
+class SGFFile {
+public:
+    explicit SGFFile(const std::string & filename, bool write_index = false);
+    ~SGFFile();
+    SGFFile(const SGFFile &) = delete;
+    SGFFile & operator=(const SGFFile &) = delete;
+
+    size_t size() const;
+    boost::string_ref game(size_t index) const;
+
+    // Offset and length of every game in data.
+    using GameList = std::vector<std::pair<uint64, uint64>>;
+    static GameList scan(boost::string_ref data);
+
+private:
+    bool load_index(const std::string & idxname, uint64 mtime);
+    void save_index(const std::string & idxname, uint64 mtime) const;
+
+    const char * m_data{nullptr};
+    size_t m_size{0};
+    bool m_mapped{false};
+    std::string m_buffer;   /* file contents where mmap is not available */
+    GameList m_games;
+};
+
 class SGFParser {
 private:
     static std::string parse_property_name(std::istringstream & strm);
@@ -18,15 +18,87 @@
 
 #include "config.h"
 #include "SMP.h"
+#include "SearchStats.h"
 
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define HAVE_MM_PAUSE
+#endif
+#if defined(USE_FUTEX) && defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define HAVE_FUTEX
+#endif
+
+namespace {
+    constexpr int UNLOCKED = 0;
+    constexpr int LOCKED = 1;
+    constexpr int CONTENDED = 2;
+
+    // Pauses between attempts double up to this many.
+    constexpr int MAX_BACKOFF = 64;
+    // Attempts before giving up the CPU.
+    constexpr int SPIN_ROUNDS = 16;
+
+    std::atomic<uint64> s_contended{0};
+    std::atomic<uint64> s_spins{0};
+    std::atomic<uint64> s_yields{0};
+    std::atomic<uint64> s_sleeps{0};
+
+    inline void cpu_relax() {
+#ifdef HAVE_MM_PAUSE
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    inline bool try_acquire(std::atomic<int> & state) {
+        auto expected = UNLOCKED;
+        return state.load(std::memory_order_relaxed) == UNLOCKED
+            && state.compare_exchange_strong(expected, LOCKED,
+                                             std::memory_order_acquire,
+                                             std::memory_order_relaxed);
+    }
+
+#ifdef HAVE_FUTEX
+    static_assert(sizeof(std::atomic<int>) == sizeof(int),
+                  "futex needs a plain int");
+
+    inline void futex_wait(std::atomic<int> & state, int value) {
+        syscall(SYS_futex, reinterpret_cast<int*>(&state),
+                FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+    }
+
+    inline void futex_wake(std::atomic<int> & state) {
+        syscall(SYS_futex, reinterpret_cast<int*>(&state),
+                FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+#endif
+}
 
 SMP::Mutex::Mutex() {
-    m_lock = false;
+    m_lock = UNLOCKED;
 }
 
 bool SMP::Mutex::is_held() {
-    return m_lock.load(std::memory_order_acquire);
+    return m_lock.load(std::memory_order_acquire) != UNLOCKED;
 }
 
 SMP::Lock::Lock(Mutex & m) {
@@ -35,17 +107,207 @@ SMP::Lock::Lock(Mutex & m) {
 }
 
 void SMP::Lock::lock() {
-    while (m_mutex->m_lock.exchange(true, std::memory_order_acquire) == true);
+    auto expected = UNLOCKED;
+    if (!m_mutex->m_lock.compare_exchange_strong(expected, LOCKED,
+                                                 std::memory_order_acquire,
+                                                 std::memory_order_relaxed)) {
+        lock_contended();
+    }
+    m_owns_lock = true;
+}
+
+void SMP::Lock::lock_contended() {
+    // Keep the bookkeeping off the fast path.
+    SearchStats::Timer timer(SearchStats::LOCK_WAIT);
+    auto & state = m_mutex->m_lock;
+    auto spins = uint64{0};
+    auto backoff = 1;
+
+    s_contended.fetch_add(1, std::memory_order_relaxed);
+    for (auto round = 0; round < SPIN_ROUNDS; round++) {
+        for (auto i = 0; i < backoff; i++) {
+            cpu_relax();
+        }
+        spins += backoff;
+        backoff = std::min(2 * backoff, MAX_BACKOFF);
+        if (try_acquire(state)) {
+            s_spins.fetch_add(spins, std::memory_order_relaxed);
+            return;
+        }
+    }
+    s_spins.fetch_add(spins, std::memory_order_relaxed);
+
+#ifdef HAVE_FUTEX
+    // Mark the lock as having waiters, so the holder wakes us up. We
+    // keep it marked once we get it, as there might be more waiters.
+    auto sleeps = uint64{0};
+    while (state.exchange(CONTENDED, std::memory_order_acquire) != UNLOCKED) {
+        futex_wait(state, CONTENDED);
+        sleeps++;
+    }
+    s_sleeps.fetch_add(sleeps, std::memory_order_relaxed);
+#else
+    auto yields = uint64{0};
+    do {
+        std::this_thread::yield();
+        yields++;
+    } while (!try_acquire(state));
+    s_yields.fetch_add(yields, std::memory_order_relaxed);
+#endif
 }
 
 void SMP::Lock::unlock() {
-    m_mutex->m_lock.store(false, std::memory_order_release);
+    // Can be called before the destructor, don't release twice.
+    if (!m_owns_lock) {
+        return;
+    }
+    m_owns_lock = false;
+#ifdef HAVE_FUTEX
+    if (m_mutex->m_lock.exchange(UNLOCKED, std::memory_order_release)
+        == CONTENDED) {
+        futex_wake(m_mutex->m_lock);
+    }
+#else
+    m_mutex->m_lock.store(UNLOCKED, std::memory_order_release);
+#endif
 }
 
 SMP::Lock::~Lock() {
     unlock();
 }
 
+SMP::LockStats SMP::get_lock_stats() {
+    auto stats = LockStats{};
+    stats.contended = s_contended.load(std::memory_order_relaxed);
+    stats.spins = s_spins.load(std::memory_order_relaxed);
+    stats.yields = s_yields.load(std::memory_order_relaxed);
+    stats.sleeps = s_sleeps.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void SMP::reset_lock_stats() {
+    s_contended = 0;
+    s_spins = 0;
+    s_yields = 0;
+    s_sleeps = 0;
+}
+
 int SMP::get_num_cpus() {
     return std::thread::hardware_concurrency();
 }
+
+namespace {
+    // Parse a sysfs CPU list such as "0-3,8-11".
+    std::vector<int> parse_cpulist(const std::string & list) {
+        auto cpus = std::vector<int>{};
+        auto ss = std::istringstream{list};
+        auto range = std::string{};
+        while (std::getline(ss, range, ',')) {
+            auto dash = range.find('-');
+            try {
+                auto first = std::stoi(range.substr(0, dash));
+                auto last = first;
+                if (dash != std::string::npos) {
+                    last = std::stoi(range.substr(dash + 1));
+                }
+                for (auto cpu = first; cpu <= last; cpu++) {
+                    cpus.push_back(cpu);
+                }
+            } catch (const std::exception&) {
+                // Blank or malformed entry, skip it.
+            }
+        }
+        return cpus;
+    }
+
+    SMP::Topology detect_topology() {
+        auto topology = SMP::Topology{};
+#ifdef __linux__
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        auto have_mask =
+            sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+        for (auto node = 0; ; node++) {
+            auto file = std::ifstream{"/sys/devices/system/node/node"
+                                      + std::to_string(node) + "/cpulist"};
+            if (!file) {
+                break;
+            }
+            auto line = std::string{};
+            std::getline(file, line);
+            auto cpus = std::vector<int>{};
+            for (auto cpu : parse_cpulist(line)) {
+                if (!have_mask || CPU_ISSET(cpu, &allowed)) {
+                    cpus.push_back(cpu);
+                }
+            }
+            if (!cpus.empty()) {
+                topology.nodes.emplace_back(std::move(cpus));
+            }
+        }
+#endif
+        if (topology.nodes.empty()) {
+            auto cpus = std::vector<int>{};
+            for (auto cpu = 0; cpu < std::max(1, SMP::get_num_cpus()); cpu++) {
+                cpus.push_back(cpu);
+            }
+            topology.nodes.emplace_back(std::move(cpus));
+        }
+        return topology;
+    }
+}
+
+const SMP::Topology & SMP::get_topology() {
+    static const auto topology = detect_topology();
+    return topology;
+}
+
+std::string SMP::describe_topology() {
+    auto out = std::ostringstream{};
+    const auto & nodes = get_topology().nodes;
+    for (auto node = size_t{0}; node < nodes.size(); node++) {
+        out << "NUMA node " << node << ":";
+        for (auto cpu : nodes[node]) {
+            out << " " << cpu;
+        }
+        out << "\n";
+    }
+    return out.str();
+}
+
+int SMP::cpu_for_thread(size_t index) {
+    auto cpus = std::vector<int>{};
+    for (const auto & node : get_topology().nodes) {
+        cpus.insert(end(cpus), begin(node), end(node));
+    }
+    return cpus[index % cpus.size()];
+}
+
+int SMP::node_of_cpu(int cpu) {
+    const auto & nodes = get_topology().nodes;
+    for (auto node = size_t{0}; node < nodes.size(); node++) {
+        if (std::find(begin(nodes[node]), end(nodes[node]), cpu)
+            != end(nodes[node])) {
+            return node;
+        }
+    }
+    return 0;
+}
+
+bool SMP::pin_thread(int cpu) {
+#if defined(__linux__)
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#elif defined(_WIN32)
+    if (cpu >= 64) {
+        return false;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(),
+                                 DWORD_PTR{1} << cpu) != 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
@@ -21,10 +21,50 @@
 
 #include "config.h"
 #include <atomic>
+#include <string>
+#include <vector>
 
 namespace SMP {
     int get_num_cpus();
 
+    /*
+        The CPUs we may run on, grouped by NUMA node. Without NUMA
+        information everything is in node 0.
+    */
+    struct Topology {
+        std::vector<std::vector<int>> nodes;
+    };
+    const Topology & get_topology();
+    std::string describe_topology();
+
+    /*
+        CPU for the index'th pinned thread. Threads fill one node
+        before moving to the next. Memory is placed on first touch,
+        so the tree nodes a pinned thread allocates stay on its node.
+    */
+    int cpu_for_thread(size_t index);
+    int node_of_cpu(int cpu);
+    // Pin the calling thread to cpu, false if that isn't supported.
+    bool pin_thread(int cpu);
+
+    /*
+        Counters for acquisitions that found the lock taken, and
+        for how those waited: pause spins, yields, or sleeps in
+        the kernel.
+    */
+    struct LockStats {
+        uint64 contended{0};
+        uint64 spins{0};
+        uint64 yields{0};
+        uint64 sleeps{0};
+    };
+    LockStats get_lock_stats();
+    void reset_lock_stats();
+
+    /*
+        Spinlock with exponential backoff. When the lock stays taken,
+        waiters yield, or sleep on a futex where available.
+    */
     class Mutex {
     public:
         Mutex();
@@ -32,7 +72,8 @@ namespace SMP {
         bool is_held();
         friend class Lock;
     private:
-        std::atomic<bool> m_lock;
+        // UNLOCKED, LOCKED or CONTENDED (locked with sleeping waiters)
+        std::atomic<int> m_lock;
     };
 
     class Lock {
@@ -42,7 +83,9 @@ namespace SMP {
         void lock();
         void unlock();
     private:
+        void lock_contended();
         Mutex * m_mutex;
+        bool m_owns_lock{false};
     };
 }
 
@@ -0,0 +1,129 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017 Gian-Carlo Pascutto
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "config.h"
+#include "SearchStats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> SearchStats::s_enabled{false};
+
+namespace {
+
+const char * counter_names[SearchStats::NUM_COUNTERS] = {
+    "select", "nn wait", "link", "backup", "tt sync", "tt update", "lock wait"
+};
+
+// Owned by one thread, which is the only writer outside of reset().
+// Padded so that two threads never write to the same cache line.
+struct ThreadCounters {
+    std::array<std::atomic<uint64>, SearchStats::NUM_COUNTERS> calls{};
+    std::array<std::atomic<uint64>, SearchStats::NUM_COUNTERS> ns{};
+    char padding[64];
+};
+
+// Counters of every thread that ever recorded something. Threads live
+// as long as the program, so entries are never removed.
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadCounters>> registry;
+
+ThreadCounters * thread_counters() {
+    thread_local ThreadCounters * counters = nullptr;
+    if (!counters) {
+        auto fresh = std::make_unique<ThreadCounters>();
+        counters = fresh.get();
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.emplace_back(std::move(fresh));
+    }
+    return counters;
+}
+
+}
+
+SearchStats::Totals SearchStats::Totals::operator-(const Totals& rhs) const {
+    auto result = *this;
+    for (auto i = 0; i < NUM_COUNTERS; i++) {
+        result.calls[i] -= rhs.calls[i];
+        result.ns[i] -= rhs.ns[i];
+    }
+    return result;
+}
+
+void SearchStats::set_enabled(bool flag) {
+    s_enabled.store(flag, std::memory_order_relaxed);
+}
+
+void SearchStats::reset() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto& counters : registry) {
+        for (auto i = 0; i < NUM_COUNTERS; i++) {
+            counters->calls[i].store(0, std::memory_order_relaxed);
+            counters->ns[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+SearchStats::Totals SearchStats::collect() {
+    auto totals = Totals{};
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto& counters : registry) {
+        for (auto i = 0; i < NUM_COUNTERS; i++) {
+            totals.calls[i] += counters->calls[i].load(std::memory_order_relaxed);
+            totals.ns[i] += counters->ns[i].load(std::memory_order_relaxed);
+        }
+    }
+    return totals;
+}
+
+void SearchStats::add(Counter counter, uint64 ns) {
+    auto counters = thread_counters();
+    counters->calls[counter].fetch_add(1, std::memory_order_relaxed);
+    counters->ns[counter].fetch_add(ns, std::memory_order_relaxed);
+}
+
+std::string SearchStats::summary(const Totals& totals, int playouts) {
+    auto res = std::string{"ns/playout:"};
+    char buff[64];
+    for (auto i = 0; i < NUM_COUNTERS; i++) {
+        snprintf(buff, sizeof(buff), " %s %llu%s", counter_names[i],
+                 totals.ns[i] / std::max(1, playouts),
+                 i + 1 < NUM_COUNTERS ? "," : "");
+        res.append(buff);
+    }
+    return res;
+}
+
+std::string SearchStats::table(const Totals& totals) {
+    auto res = std::string{};
+    char buff[128];
+    snprintf(buff, sizeof(buff), "%-10s %12s %12s %10s",
+             "counter", "calls", "total ms", "avg ns");
+    res.append(buff);
+    for (auto i = 0; i < NUM_COUNTERS; i++) {
+        snprintf(buff, sizeof(buff), "\n%-10s %12llu %12.1f %10llu",
+                 counter_names[i], totals.calls[i], totals.ns[i] / 1e6,
+                 totals.calls[i] ? totals.ns[i] / totals.calls[i] : 0ULL);
+        res.append(buff);
+    }
+    return res;
+}
@@ -0,0 +1,86 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017 Gian-Carlo Pascutto
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SEARCHSTATS_H_INCLUDED
+#define SEARCHSTATS_H_INCLUDED
+
+#include "config.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+/*
+    Timers for the search hot path. Each thread accumulates into
+    its own counters, which are only summed when somebody asks.
+    When disabled, a timer costs a single relaxed load.
+*/
+class SearchStats {
+public:
+    enum Counter {
+        SELECTION, NN_EVAL, LINKING, BACKUP, TT_SYNC, TT_UPDATE, LOCK_WAIT,
+        NUM_COUNTERS
+    };
+
+    struct Totals {
+        std::array<uint64, NUM_COUNTERS> calls{};
+        std::array<uint64, NUM_COUNTERS> ns{};
+        Totals operator-(const Totals& rhs) const;
+    };
+
+    static bool enabled() {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+    static void set_enabled(bool flag);
+    static void reset();
+    static Totals collect();
+    static void add(Counter counter, uint64 ns);
+
+    // One line with the time per playout spent in each part.
+    static std::string summary(const Totals& totals, int playouts);
+    // One line per counter with calls, total and average time.
+    static std::string table(const Totals& totals);
+
+    class Timer {
+    public:
+        explicit Timer(Counter counter)
+            : m_counter(counter), m_active(enabled()) {
+            if (m_active) {
+                m_start = std::chrono::steady_clock::now();
+            }
+        }
+        ~Timer() {
+            if (m_active) {
+                auto end = std::chrono::steady_clock::now();
+                add(m_counter, std::chrono::duration_cast<
+                    std::chrono::nanoseconds>(end - m_start).count());
+            }
+        }
+    private:
+        Counter m_counter;
+        bool m_active;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+#endif
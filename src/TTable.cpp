@@ -76,3 +76,8 @@ void TTable::sync(uint64 hash, const float komi, UCTNode * node) {
         node->set_blackevals(m_buckets[index].m_eval_sum);
     }
 }
+
+void TTable::clear() {
+    LOCK(m_mutex, lock);
+    std::fill(begin(m_buckets), end(m_buckets), TTEntry());
+}
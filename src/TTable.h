@@ -50,6 +50,11 @@ public:
     */
     void sync(uint64 hash, const float komi, UCTNode * node);
 
+    /*
+        drop all entries
+    */
+    void clear();
+
 private:
     TTable(int size = 500000);
 
@@ -24,53 +24,279 @@
     distribution.
 */
 
+#include <atomic>
 #include <cstddef>
+#include <deque>
+#include <exception>
 #include <vector>
 #include <thread>
-#include <queue>
 #include <mutex>
 #include <condition_variable>
 #include <memory>
 #include <future>
 #include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace Utils {
 
+/*
+    A move-only callable. Anything up to INLINE_SIZE bytes is stored
+    in place, so queueing the usual lambda or functor doesn't touch
+    the heap. Larger callables fall back to an allocation.
+*/
+class Task {
+public:
+    Task() = default;
+    template<class F, class = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F&& f) {
+        using T = typename std::decay<F>::type;
+        emplace<T>(std::forward<F>(f), std::integral_constant<bool,
+            sizeof(T) <= INLINE_SIZE
+            && alignof(T) <= alignof(Storage)
+            && std::is_nothrow_move_constructible<T>::value>{});
+    }
+    Task(Task&& other) noexcept {
+        take(other);
+    }
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+    ~Task() {
+        reset();
+    }
+    explicit operator bool() const {
+        return m_ops != nullptr;
+    }
+    void operator()() {
+        m_ops->invoke(&m_storage);
+    }
+
+private:
+    static constexpr std::size_t INLINE_SIZE = 48;
+    using Storage = std::aligned_storage<INLINE_SIZE,
+                                         alignof(std::max_align_t)>::type;
+
+    struct Ops {
+        void (*invoke)(void*);
+        // Move construct into dst and destroy the source.
+        void (*relocate)(void* dst, void* src);
+        void (*destroy)(void*);
+    };
+
+    template<class T>
+    static const Ops* inline_ops() {
+        static const Ops ops = {
+            [](void* p) { (*static_cast<T*>(p))(); },
+            [](void* dst, void* src) {
+                new (dst) T(std::move(*static_cast<T*>(src)));
+                static_cast<T*>(src)->~T();
+            },
+            [](void* p) { static_cast<T*>(p)->~T(); }
+        };
+        return &ops;
+    }
+
+    template<class T>
+    static const Ops* heap_ops() {
+        static const Ops ops = {
+            [](void* p) { (**static_cast<T**>(p))(); },
+            [](void* dst, void* src) {
+                *static_cast<T**>(dst) = *static_cast<T**>(src);
+            },
+            [](void* p) { delete *static_cast<T**>(p); }
+        };
+        return &ops;
+    }
+
+    template<class T, class F>
+    void emplace(F&& f, std::true_type) {
+        new (&m_storage) T(std::forward<F>(f));
+        m_ops = inline_ops<T>();
+    }
+
+    template<class T, class F>
+    void emplace(F&& f, std::false_type) {
+        *reinterpret_cast<T**>(&m_storage) = new T(std::forward<F>(f));
+        m_ops = heap_ops<T>();
+    }
+
+    void take(Task& other) {
+        if (other.m_ops) {
+            other.m_ops->relocate(&m_storage, &other.m_storage);
+            m_ops = other.m_ops;
+            other.m_ops = nullptr;
+        }
+    }
+
+    void reset() {
+        if (m_ops) {
+            m_ops->destroy(&m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+    Storage m_storage;
+    const Ops* m_ops{nullptr};
+};
+
+/*
+    Work stealing pool. Every thread has its own deque: it takes its
+    own work from the back and steals from the front of the others
+    when it runs dry. Tasks queued from inside the pool go to the
+    queueing thread's deque, others are spread round robin.
+*/
 class ThreadPool {
 public:
     ThreadPool() = default;
     ~ThreadPool();
-    void initialize(std::size_t);
+    // on_start runs first thing on each new thread, with its index.
+    void initialize(std::size_t,
+                    std::function<void(std::size_t)> on_start = nullptr);
     template<class F, class... Args>
     auto add_task(F&& f, Args&&... args)
         -> std::future<typename std::result_of<F(Args...)>::type>;
+    void submit(Task task);
+    // Queue count copies of f with a single wakeup.
+    template<class F>
+    void submit_bulk(std::size_t count, const F& f);
 private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void worker_loop(std::size_t index,
+                     const std::function<void(std::size_t)>& on_start);
+    bool pop_task(std::size_t index, Task& task);
+    std::size_t home_queue();
+    void push(std::size_t index, Task task);
+    void wake(std::size_t count);
+
+    // Which pool and deque the calling thread works for.
+    static ThreadPool*& current_pool() {
+        static thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+    static std::size_t& current_index() {
+        static thread_local std::size_t index = 0;
+        return index;
+    }
+
     std::vector<std::thread> m_threads;
-    std::queue<std::function<void()>> m_tasks;
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    std::atomic<std::size_t> m_pending{0};
+    std::atomic<std::size_t> m_next_queue{0};
 
+    // Only used to sleep when there is no work.
     std::mutex m_mutex;
     std::condition_variable m_condvar;
     bool m_exit{false};
 };
 
-inline void ThreadPool::initialize(size_t threads) {
+inline void ThreadPool::initialize(size_t threads,
+    std::function<void(std::size_t)> on_start) {
     for (size_t i = 0; i < threads; i++) {
-        m_threads.emplace_back([this] {
-            for (;;) {
-                std::function<void()> task;
-                {
-                    std::unique_lock<std::mutex> lock(m_mutex);
-                    m_condvar.wait(lock, [this]{ return m_exit || !m_tasks.empty(); });
-                    if (m_exit && m_tasks.empty()) {
-                        return;
-                    }
-                    task = std::move(m_tasks.front());
-                    m_tasks.pop();
-                }
-                task();
-            }
+        m_queues.emplace_back(std::make_unique<WorkQueue>());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        m_threads.emplace_back([this, i, on_start] {
+            worker_loop(i, on_start);
+        });
+    }
+}
+
+inline void ThreadPool::worker_loop(std::size_t index,
+    const std::function<void(std::size_t)>& on_start) {
+    if (on_start) {
+        on_start(index);
+    }
+    current_pool() = this;
+    current_index() = index;
+    for (;;) {
+        Task task;
+        if (pop_task(index, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condvar.wait(lock, [this] {
+            return m_exit || m_pending.load() > 0;
         });
+        if (m_exit && m_pending.load() == 0) {
+            return;
+        }
+    }
+}
+
+inline bool ThreadPool::pop_task(std::size_t index, Task& task) {
+    {
+        auto& own = *m_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            m_pending--;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < m_queues.size(); i++) {
+        auto& victim = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            m_pending--;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline std::size_t ThreadPool::home_queue() {
+    if (current_pool() == this) {
+        return current_index();
+    }
+    return m_next_queue++ % m_queues.size();
+}
+
+inline void ThreadPool::push(std::size_t index, Task task) {
+    auto& queue = *m_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.emplace_back(std::move(task));
+    // Counted under the queue lock, so a worker can't take the task
+    // and decrement before we increment.
+    m_pending++;
+}
+
+inline void ThreadPool::wake(std::size_t count) {
+    // Taking the lock orders us against a worker about to sleep.
+    { std::lock_guard<std::mutex> lock(m_mutex); }
+    if (count == 1) {
+        m_condvar.notify_one();
+    } else {
+        m_condvar.notify_all();
+    }
+}
+
+inline void ThreadPool::submit(Task task) {
+    push(home_queue(), std::move(task));
+    wake(1);
+}
+
+template<class F>
+void ThreadPool::submit_bulk(std::size_t count, const F& f) {
+    auto first = home_queue();
+    for (size_t i = 0; i < count; i++) {
+        push((first + i) % m_queues.size(), Task(f));
     }
+    wake(count);
 }
 
 template<class F, class... Args>
@@ -78,16 +304,12 @@ auto ThreadPool::add_task(F&& f, Args&&... args)
     -> std::future<typename std::result_of<F(Args...)>::type> {
     using return_type = typename std::result_of<F(Args...)>::type;
 
-    auto task = std::make_shared< std::packaged_task<return_type()> >(
+    auto task = std::packaged_task<return_type()>(
         std::bind(std::forward<F>(f), std::forward<Args>(args)...)
     );
 
-    std::future<return_type> res = task->get_future();
-    {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        m_tasks.emplace([task](){(*task)();});
-    }
-    m_condvar.notify_one();
+    std::future<return_type> res = task.get_future();
+    submit(Task(std::move(task)));
     return res;
 }
 
@@ -102,23 +324,74 @@ inline ThreadPool::~ThreadPool() {
     }
 }
 
+/*
+    Tasks that are waited for together. Only a counter is kept per
+    group, so queueing a task doesn't create a future. The first
+    exception thrown by a task is rethrown from wait_all().
+*/
 class ThreadGroup {
 public:
     ThreadGroup(ThreadPool & pool) : m_pool(pool) {}
-    template<class F, class... Args>
-    void add_task(F&& f, Args&&... args) {
-        m_taskresults.emplace_back(
-            m_pool.add_task(std::forward<F>(f), std::forward<Args>(args)...)
-        );
+    ~ThreadGroup() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condvar.wait(lock, [this] { return m_pending == 0; });
+    }
+    template<class F>
+    void add_task(F&& f) {
+        started(1);
+        m_pool.submit(Task(Runner<typename std::decay<F>::type>{
+            this, std::forward<F>(f)}));
+    }
+    // Run count copies of f.
+    template<class F>
+    void add_tasks(std::size_t count, const F& f) {
+        started(count);
+        m_pool.submit_bulk(count, Runner<F>{this, f});
     }
     void wait_all() {
-        for (auto && result: m_taskresults) {
-            result.get();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condvar.wait(lock, [this] { return m_pending == 0; });
+        if (m_exception) {
+            auto exception = m_exception;
+            m_exception = nullptr;
+            std::rethrow_exception(exception);
         }
     }
 private:
+    template<class F>
+    struct Runner {
+        ThreadGroup * group;
+        F func;
+        void operator()() {
+            auto exception = std::exception_ptr{};
+            try {
+                func();
+            } catch (...) {
+                exception = std::current_exception();
+            }
+            group->finished(exception);
+        }
+    };
+
+    void started(std::size_t count) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending += count;
+    }
+    void finished(std::exception_ptr exception) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (exception && !m_exception) {
+            m_exception = exception;
+        }
+        if (--m_pending == 0) {
+            m_condvar.notify_all();
+        }
+    }
+
     ThreadPool & m_pool;
-    std::vector<std::future<void>> m_taskresults;
+    std::mutex m_mutex;
+    std::condition_variable m_condvar;
+    std::size_t m_pending{0};
+    std::exception_ptr m_exception;
 };
 
 }
@@ -192,6 +192,17 @@ int TimeControl::max_time_for_move(int color) {
     return timealloc;
 }
 
+bool TimeControl::can_accumulate_time(int color) {
+    /*
+        unused time in a byo yomi period is lost,
+        everything else is kept for later moves
+    */
+    if (m_inbyo[color] && !m_byostones) {
+        return false;
+    }
+    return true;
+}
+
 void TimeControl::adjust_time(int color, int time, int stones) {
     m_remaining_time[color] = time;
     // From pachi: some GTP things send 0 0 at the end of main time
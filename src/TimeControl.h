@@ -35,6 +35,7 @@ public:
     void start(int color);
     void stop(int color);
     int max_time_for_move(int color);
+    bool can_accumulate_time(int color);
     void adjust_time(int color, int time, int stones);
     void set_boardsize(int boardsize);
     void display_times();
@@ -21,6 +21,7 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <numeric>
 #include <boost/utility.hpp>
 #include "stdlib.h"
 #include "zlib.h"
@@ -31,6 +32,7 @@
 #include "SGFParser.h"
 #include "SGFTree.h"
 #include "Random.h"
+#include "Replay.h"
 #include "Utils.h"
 
 std::vector<TimeStep> Training::m_data{};
@@ -211,57 +213,46 @@ void Training::dump_stats(OutputChunker& outchunk) {
     }
 }
 
-void Training::process_game(GameState& state, size_t& train_pos, int who_won,
+void Training::process_game(const KoState& start, size_t& train_pos,
+                            int who_won,
                             const std::vector<int>& tree_moves,
                             OutputChunker& outchunker) {
     clear_training();
-    auto counter = size_t{0};
-    state.rewind();
 
-    do {
-        auto to_move = state.get_to_move();
-        auto move = tree_moves[counter];
-        auto this_move = size_t{0};
-
-        // Detect if this SGF seems to be corrupted
-        auto moves = state.generate_moves(to_move);
-        auto moveseen = false;
-        for(const auto& gen_move : moves) {
-            if (gen_move == move) {
-                if (move != FastBoard::PASS) {
-                    // get x y coords for actual move
-                    auto xy = state.board.get_xy(move);
-                    this_move = (xy.second * 19) + xy.first;
-                } else {
-                    this_move = (19 * 19); // PASS
-                }
-                moveseen = true;
-                break;
-            }
+    auto replay = Replay{start};
+    auto valid = replay.run(tree_moves, [&](const Replay& pos, int move) {
+        // Pick every 1/SKIP_SIZE th position.
+        auto skip = Random::get_Rng().randfix<SKIP_SIZE>();
+        if (skip != 0) {
+            return;
         }
 
-        if (!moveseen) {
-            std::cout << "Mainline move not found: " << move << std::endl;
-            return;
+        auto this_move = size_t{0};
+        if (move != FastBoard::PASS) {
+            // get x y coords for actual move
+            auto xy = pos.get_state().board.get_xy(move);
+            this_move = (xy.second * 19) + xy.first;
+        } else {
+            this_move = (19 * 19); // PASS
         }
 
-        // Pick every 1/SKIP_SIZE th position.
-        auto skip = Random::get_Rng().randfix<SKIP_SIZE>();
-        if (skip == 0) {
-            auto step = TimeStep{};
-            step.to_move = state.board.get_to_move();
-            step.planes = Network::NNPlanes{};
-            Network::gather_features(&state, step.planes);
+        auto step = TimeStep{};
+        step.to_move = pos.get_state().get_to_move();
+        step.planes = Network::NNPlanes{};
+        pos.gather_features(step.planes);
 
-            step.probabilities.resize((19 * 19) + 1);
-            step.probabilities[this_move] = 1.0f;
+        step.probabilities.resize((19 * 19) + 1);
+        step.probabilities[this_move] = 1.0f;
 
-            train_pos++;
-            m_data.emplace_back(step);
-        }
+        train_pos++;
+        m_data.emplace_back(step);
+    });
 
-        counter++;
-    } while (state.forward_move() && counter < tree_moves.size());
+    // Detect if this SGF seems to be corrupted
+    if (!valid) {
+        std::cout << "Mainline move not legal, skipping game" << std::endl;
+        return;
+    }
 
     dump_training(who_won, outchunker);
 }
@@ -269,8 +260,12 @@ void Training::process_game(GameState& state, size_t& train_pos, int who_won,
 void Training::dump_supervised(const std::string& sgf_name,
                                const std::string& out_filename) {
     auto outchunker = OutputChunker{out_filename, true};
-    auto games = SGFParser::chop_all(sgf_name);
-    auto gametotal = games.size();
+    // The games stay in the mapped file, only their order is shuffled.
+    // Keep an index next to it, these collections get dumped repeatedly.
+    SGFFile sgffile(sgf_name, true);
+    auto gametotal = sgffile.size();
+    auto games = std::vector<size_t>(gametotal);
+    std::iota(begin(games), end(games), size_t{0});
     auto train_pos = size_t{0};
 
     std::cout << "Total games in file: " << gametotal << std::endl;
@@ -285,7 +280,8 @@ void Training::dump_supervised(const std::string& sgf_name,
         for (auto gamecount = size_t{0}; gamecount < gametotal; gamecount++) {
             auto sgftree = std::make_unique<SGFTree>();
             try {
-                sgftree->load_from_string(games[gamecount]);
+                sgftree->load_from_string(
+                    sgffile.game(games[gamecount]).to_string());
             } catch (...) {
                 continue;
             };
@@ -307,14 +303,15 @@ void Training::dump_supervised(const std::string& sgf_name,
                 continue;
             }
 
-            auto state =
-                std::make_unique<GameState>(sgftree->follow_mainline_state());
+            // Replay from the root position (after handicap stones),
+            // without building a GameState history for every move.
+            const auto& start = *sgftree->get_state();
             // Our board size is hardcoded in several places
-            if (state->board.get_boardsize() != 19) {
+            if (start.board.get_boardsize() != 19) {
                 continue;
             }
 
-            process_game(*state, train_pos, who_won, tree_moves,
+            process_game(start, train_pos, who_won, tree_moves,
                         outchunker);
         }
     }
@@ -69,7 +69,8 @@ private:
     // This ensures that positions in a chunk are from disjoint games.
     static constexpr size_t SKIP_SIZE = 16;
 
-    static void process_game(GameState& state, size_t& train_pos, int who_won,
+    static void process_game(const KoState& start, size_t& train_pos,
+                             int who_won,
                              const std::vector<int>& tree_moves,
                              OutputChunker& outchunker);
     static void dump_training(int winner_color,
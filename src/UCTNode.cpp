@@ -19,10 +19,15 @@
 #include "config.h"
 
 #include <stdlib.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
 #include <limits>
+#include <cstddef>
+#include <cstdlib>
 #include <cmath>
 
 #include <iostream>
@@ -31,6 +36,7 @@
 #include <algorithm>
 #include <random>
 #include <numeric>
+#include <thread>
 #include "FastState.h"
 #include "UCTNode.h"
 #include "UCTSearch.h"
@@ -38,6 +44,7 @@
 #include "Network.h"
 #include "GTP.h"
 #include "Random.h"
+#include "SearchStats.h"
 #ifdef USE_OPENCL
 #include "OpenCL.h"
 #endif
@@ -48,6 +55,23 @@ UCTNode::UCTNode(int vertex, float score, float init_eval)
     : m_move(vertex), m_score(score), m_init_eval(init_eval) {
 }
 
+size_t UCTNode::allocated_size() {
+    static const auto size = []() {
+#ifdef __GLIBC__
+        // Usable size of a node-sized block plus its chunk header.
+        auto block = std::malloc(sizeof(UCTNode));
+        auto usable = malloc_usable_size(block);
+        std::free(block);
+        return usable + sizeof(size_t);
+#else
+        // Assume a header and rounding up to the allocator alignment.
+        constexpr auto align = alignof(std::max_align_t);
+        return (sizeof(UCTNode) + 2 * align - 1) / align * align;
+#endif
+    }();
+    return size;
+}
+
 UCTNode::~UCTNode() {
     LOCK(get_mutex(), lock);
     UCTNode * next = m_firstchild;
@@ -60,7 +84,7 @@ UCTNode::~UCTNode() {
 }
 
 bool UCTNode::first_visit() const {
-    return m_visits == 0;
+    return get_visits() == 0;
 }
 
 void UCTNode::link_child(UCTNode * newchild) {
@@ -75,6 +99,22 @@ SMP::Mutex & UCTNode::get_mutex() {
 bool UCTNode::create_children(std::atomic<int> & nodecount,
                               GameState & state,
                               float & eval) {
+    if (!acquire_expansion(state)) {
+        return false;
+    }
+
+    Network::Netresult raw_netlist;
+    {
+        SearchStats::Timer timer(SearchStats::NN_EVAL);
+        raw_netlist = Network::get_scored_moves(
+            &state, Network::Ensemble::RANDOM_ROTATION);
+    }
+
+    eval = finish_expansion(nodecount, state, raw_netlist);
+    return true;
+}
+
+bool UCTNode::acquire_expansion(GameState & state) {
     // check whether somebody beat us to it (atomic)
     if (has_children()) {
         return false;
@@ -95,11 +135,12 @@ bool UCTNode::create_children(std::atomic<int> & nodecount,
     }
     // We'll be the one queueing this node for expansion, stop others
     m_is_expanding = true;
-    lock.unlock();
-
-    auto raw_netlist = Network::get_scored_moves(
-        &state, Network::Ensemble::RANDOM_ROTATION);
+    return true;
+}
 
+float UCTNode::finish_expansion(std::atomic<int> & nodecount,
+                                GameState & state,
+                                const Network::Netresult & raw_netlist) {
     // DCNN returns winrate as side to move
     auto net_eval = raw_netlist.second;
     auto to_move = state.board.get_to_move();
@@ -107,17 +148,23 @@ bool UCTNode::create_children(std::atomic<int> & nodecount,
     if (to_move == FastBoard::WHITE) {
         net_eval = 1.0f - net_eval;
     }
-    eval = net_eval;
+
+    // Everything from here on is building the child list.
+    SearchStats::Timer timer(SearchStats::LINKING);
 
     FastBoard & board = state.board;
     std::vector<Network::scored_node> nodelist;
 
+    auto legal = board.get_legal_bb(to_move);
+    if (state.m_komove > 0) {
+        legal.reset(board.vertex_to_bit(state.m_komove));
+    }
+
     auto legal_sum = 0.0f;
     for (auto& node : raw_netlist.first) {
         auto vertex = node.second;
         if (vertex != FastBoard::PASS) {
-            if (vertex != state.m_komove
-                && !board.is_suicide(vertex, board.get_to_move())) {
+            if (legal.test(board.vertex_to_bit(vertex))) {
                 nodelist.emplace_back(node);
                 legal_sum += node.first;
             }
@@ -137,7 +184,7 @@ bool UCTNode::create_children(std::atomic<int> & nodecount,
 
     link_nodelist(nodecount, nodelist, net_eval);
 
-    return true;
+    return net_eval;
 }
 
 void UCTNode::link_nodelist(std::atomic<int> & nodecount,
@@ -189,8 +236,12 @@ void UCTNode::kill_superkos(KoState & state) {
 }
 
 float UCTNode::eval_state(GameState& state) {
-    auto raw_netlist = Network::get_scored_moves(
-        &state, Network::Ensemble::RANDOM_ROTATION);
+    Network::Netresult raw_netlist;
+    {
+        SearchStats::Timer timer(SearchStats::NN_EVAL);
+        raw_netlist = Network::get_scored_moves(
+            &state, Network::Ensemble::RANDOM_ROTATION);
+    }
 
     // DCNN returns winrate as side to move
     auto net_eval = raw_netlist.second;
@@ -297,16 +348,30 @@ int UCTNode::get_move() const {
 }
 
 void UCTNode::virtual_loss() {
-    m_virtual_loss += VIRTUAL_LOSS_COUNT;
+    m_visit_stats.fetch_add(uint64{VIRTUAL_LOSS_COUNT} << VIRTUAL_LOSS_SHIFT);
 }
 
 void UCTNode::virtual_loss_undo() {
-    m_virtual_loss -= VIRTUAL_LOSS_COUNT;
+    m_visit_stats.fetch_sub(uint64{VIRTUAL_LOSS_COUNT} << VIRTUAL_LOSS_SHIFT);
+}
+
+void UCTNode::add_stats(double blackevals, uint64 stats_delta) {
+    // Mark the update as in progress while the two words disagree.
+    m_visit_stats.fetch_add(PENDING_ONE);
+    m_blackevals.fetch_add(static_cast<uint64>(blackevals * EVAL_ONE + 0.5));
+    m_visit_stats.fetch_add(stats_delta - PENDING_ONE);
 }
 
 void UCTNode::update(float eval) {
-    m_visits++;
-    accumulate_eval(eval);
+    add_stats(eval, 1);
+}
+
+void UCTNode::backup(float eval) {
+    add_stats(eval, 1 - (uint64{VIRTUAL_LOSS_COUNT} << VIRTUAL_LOSS_SHIFT));
+}
+
+void UCTNode::merge(int visits, double blackevals) {
+    add_stats(blackevals, static_cast<uint32>(visits));
 }
 
 bool UCTNode::has_children() const {
@@ -314,7 +379,10 @@ bool UCTNode::has_children() const {
 }
 
 void UCTNode::set_visits(int visits) {
-    m_visits = visits;
+    // Keep the virtual losses of searches that are passing through.
+    auto stats = m_visit_stats.load();
+    while (!m_visit_stats.compare_exchange_weak(
+        stats, (stats & ~VISIT_MASK) | static_cast<uint32>(visits))) {}
 }
 
 float UCTNode::get_score() const {
@@ -326,17 +394,43 @@ void UCTNode::set_score(float score) {
 }
 
 int UCTNode::get_visits() const {
-    return m_visits;
+    return static_cast<int>(m_visit_stats.load() & VISIT_MASK);
+}
+
+void UCTNode::get_stats(int & visits, int & virtual_loss,
+                        double & blackevals) const {
+    // Retry while an update is between its two adds, or one started
+    // while we read the sum. Updates are only a few instructions long.
+    auto stats = uint64{};
+    auto evals = uint64{};
+    for (;;) {
+        stats = m_visit_stats.load();
+        if (stats >> PENDING_SHIFT) {
+            // The writer may have been preempted, let it finish.
+            std::this_thread::yield();
+            continue;
+        }
+        evals = m_blackevals.load();
+        if (m_visit_stats.load() == stats) {
+            break;
+        }
+    }
+    visits = static_cast<int>(stats & VISIT_MASK);
+    virtual_loss = static_cast<int>((stats >> VIRTUAL_LOSS_SHIFT)
+                                    & VIRTUAL_LOSS_MASK);
+    blackevals = evals / EVAL_ONE;
 }
 
 float UCTNode::get_eval(int tomove) const {
     // Due to the use of atomic updates and virtual losses, it is
     // possible for the visit count to change underneath us. Make sure
-    // to return a consistent result to the caller by caching the values.
-    auto virtual_loss = int{m_virtual_loss};
-    auto visits = get_visits() + virtual_loss;
+    // to return a consistent result to the caller by taking a snapshot.
+    auto visits = int{};
+    auto virtual_loss = int{};
+    auto blackeval = double{};
+    get_stats(visits, virtual_loss, blackeval);
+    visits += virtual_loss;
     if (visits > 0) {
-        auto blackeval = get_blackevals();
         if (tomove == FastBoard::WHITE) {
             blackeval += static_cast<double>(virtual_loss);
         }
@@ -357,15 +451,15 @@ float UCTNode::get_eval(int tomove) const {
 }
 
 double UCTNode::get_blackevals() const {
-    return m_blackevals;
+    return m_blackevals.load() / EVAL_ONE;
 }
 
 void UCTNode::set_blackevals(double blackevals) {
-    m_blackevals = blackevals;
+    m_blackevals = static_cast<uint64>(blackevals * EVAL_ONE + 0.5);
 }
 
 void UCTNode::accumulate_eval(float eval) {
-    atomic_add(m_blackevals, (double)eval);
+    add_stats(eval, 0);
 }
 
 UCTNode* UCTNode::uct_select_child(int color) {
@@ -552,6 +646,66 @@ bool UCTNode::valid() const {
 
 // unsafe in SMP, we don't know if people hold pointers to the
 // child which they might dereference
+int UCTNode::count_nodes() const {
+    auto nodes = 0;
+    for (auto child = m_firstchild; child != nullptr;
+         child = child->m_nextsibling) {
+        nodes += 1 + child->count_nodes();
+    }
+    return nodes;
+}
+
+std::unique_ptr<UCTNode> UCTNode::unlink_child(int move) {
+    LOCK(get_mutex(), lock);
+    UCTNode * prev = nullptr;
+    for (auto child = m_firstchild; child != nullptr;
+         child = child->m_nextsibling) {
+        if (child->m_move == move) {
+            if (prev == nullptr) {
+                m_firstchild = child->m_nextsibling;
+            } else {
+                prev->m_nextsibling = child->m_nextsibling;
+            }
+            child->m_nextsibling = nullptr;
+            return std::unique_ptr<UCTNode>(child);
+        }
+        prev = child;
+    }
+    return nullptr;
+}
+
+int UCTNode::prune(int min_visits) {
+    // Must not run concurrently with a search.
+    auto freed = 0;
+    for (auto child = m_firstchild; child != nullptr;
+         child = child->m_nextsibling) {
+        if (!child->has_children()) {
+            continue;
+        }
+        if (child->get_visits() < min_visits) {
+            freed += child->unexpand();
+        } else {
+            freed += child->prune(min_visits);
+        }
+    }
+    return freed;
+}
+
+int UCTNode::unexpand() {
+    auto freed = count_nodes();
+    auto child = m_firstchild;
+    while (child != nullptr) {
+        auto next = child->m_nextsibling;
+        delete child;
+        child = next;
+    }
+    // The next visit expands the node again.
+    m_firstchild = nullptr;
+    m_has_children = false;
+    m_is_expanding = false;
+    return freed;
+}
+
 void UCTNode::delete_child(UCTNode * del_child) {
     LOCK(get_mutex(), lock);
     assert(del_child != nullptr);
@@ -24,6 +24,7 @@
 #include <tuple>
 #include <atomic>
 #include <limits>
+#include <memory>
 
 #include "SMP.h"
 #include "GameState.h"
@@ -37,15 +38,32 @@ public:
     // to it to encourage other CPUs to explore other parts of the
     // search tree.
     static constexpr auto VIRTUAL_LOSS_COUNT = 3;
+    // Simulations that can pass through a node at once before its
+    // virtual loss count overflows.
+    static constexpr auto MAX_CONCURRENT_SIMS = 0xffff / VIRTUAL_LOSS_COUNT;
 
     explicit UCTNode(int vertex, float score, float init_eval);
     ~UCTNode();
+    // Memory a node really takes on the heap, allocator overhead included.
+    static size_t allocated_size();
     bool first_visit() const;
     bool has_children() const;
     bool create_children(std::atomic<int> & nodecount,
                          GameState & state, float & eval);
+    /*
+        create_children() in two halves, so the network evaluation
+        can run elsewhere in between. If acquire_expansion() returns
+        true, the caller must call finish_expansion().
+    */
+    bool acquire_expansion(GameState & state);
+    float finish_expansion(std::atomic<int> & nodecount,
+                           GameState & state,
+                           const Network::Netresult & raw_netlist);
     float eval_state(GameState& state);
     void kill_superkos(KoState & state);
+    int count_nodes() const;
+    std::unique_ptr<UCTNode> unlink_child(int move);
+    int prune(int min_visits);
     void delete_child(UCTNode * child);
     void invalidate();
     bool valid() const;
@@ -61,6 +79,10 @@ public:
     void accumulate_eval(float eval);
     void virtual_loss(void);
     void virtual_loss_undo(void);
+    // update() and virtual_loss_undo() in one atomic step
+    void backup(float eval);
+    // Add visits and their eval sum from a search done elsewhere.
+    void merge(int visits, double blackevals);
     void dirichlet_noise(float epsilon, float alpha);
     void randomize_first_proportionally();
     void update(float eval = std::numeric_limits<float>::quiet_NaN());
@@ -73,33 +95,54 @@ public:
     void sort_root_children(int color);
     UCTNode* get_best_root_child(int color);
     SMP::Mutex & get_mutex();
+    void link_nodelist(std::atomic<int> & nodecount,
+                       std::vector<Network::scored_node> & nodelist,
+                       float init_eval);
 
 private:
     UCTNode();
     void link_child(UCTNode * newchild);
-    void link_nodelist(std::atomic<int> & nodecount,
-                       std::vector<Network::scored_node> & nodelist,
-                       float init_eval);
+    int unexpand();
+
+    /*
+        Visits are the low 32 bits of m_visit_stats, virtual losses the
+        next 16 bits, so both change together with a single fetch_add.
+        The top 16 bits count updates in progress: those raise it,
+        add to m_blackevals, then lower it while adding their visit.
+        Readers retry until they see no update in progress and the same
+        counts before and after reading the sum, so the eval sum always
+        matches the visits.
+        m_blackevals is a fixed point sum with 32 fractional bits.
+    */
+    static constexpr auto VISIT_MASK = uint64{0xffffffff};
+    static constexpr auto VIRTUAL_LOSS_SHIFT = 32;
+    static constexpr auto VIRTUAL_LOSS_MASK = uint64{0xffff};
+    static constexpr auto PENDING_SHIFT = 48;
+    static constexpr auto PENDING_ONE = uint64{1} << PENDING_SHIFT;
+    static constexpr auto EVAL_ONE = double(uint64{1} << 32);
+
+    void add_stats(double blackevals, uint64 stats_delta);
+    void get_stats(int & visits, int & virtual_loss,
+                   double & blackevals) const;
 
     // Tree data
-    std::atomic<bool> m_has_children{false};
     UCTNode* m_firstchild{nullptr};
     UCTNode* m_nextsibling{nullptr};
+    // UCT
+    std::atomic<uint64> m_visit_stats{0};
+    std::atomic<uint64> m_blackevals{0};
     // Move
     int m_move;
-    // UCT
-    std::atomic<int> m_visits{0};
-    std::atomic<int> m_virtual_loss{0};
     // UCT eval
     float m_score;
     float m_init_eval;
-    std::atomic<double> m_blackevals{0};
+    SMP::Mutex m_nodemutex;
+    std::atomic<bool> m_has_children{false};
     // node alive (not superko)
     std::atomic<bool> m_valid{true};
     // Is someone adding scores to this node?
     // We don't need to unset this.
     bool m_is_expanding{false};
-    SMP::Mutex m_nodemutex;
 };
 
 #endif
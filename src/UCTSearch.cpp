@@ -31,9 +31,11 @@
 #include "UCTSearch.h"
 #include "Timing.h"
 #include "Random.h"
+#include "RootParallel.h"
 #include "Utils.h"
 #include "Network.h"
 #include "GTP.h"
+#include "SearchStats.h"
 #include "TTable.h"
 #include "Training.h"
 #ifdef USE_OPENCL
@@ -45,62 +47,200 @@ using namespace Utils;
 UCTSearch::UCTSearch(GameState & g)
     : m_rootstate(g) {
     set_playout_limit(cfg_max_playouts);
+    m_root = std::make_unique<UCTNode>(FastBoard::PASS, 0.0f, 0.5f);
+    m_maxnodes = static_cast<int>(std::min<size_t>(
+        cfg_max_tree_memory / UCTNode::allocated_size(),
+        std::numeric_limits<int>::max()));
 }
 
-SearchResult UCTSearch::play_simulation(GameState & currstate, UCTNode* const node) {
-    const auto color = currstate.get_to_move();
-    const auto hash = currstate.board.get_hash();
-    const auto komi = currstate.get_komi();
+const GameState & UCTSearch::get_rootstate() const {
+    return m_rootstate;
+}
+
+bool UCTSearch::advance_to_new_rootstate() {
+    if (!m_last_rootstate
+        || m_last_rootstate->get_komi() != m_rootstate.get_komi()) {
+        return false;
+    }
+    auto depth = int(m_rootstate.get_movenum())
+                 - int(m_last_rootstate->get_movenum());
+    if (depth < 0) {
+        return false;
+    }
 
-    auto result = SearchResult{};
+    // Go back to where the tree is, check it's the same position,
+    // then follow the moves played since down the tree.
+    auto test = std::make_unique<GameState>(m_rootstate);
+    for (auto i = 0; i < depth; i++) {
+        test->undo_move();
+    }
+    if (test->board.get_hash() != m_last_rootstate->board.get_hash()
+        || test->get_to_move() != m_last_rootstate->get_to_move()) {
+        return false;
+    }
+    for (auto i = 0; i < depth; i++) {
+        test->forward_move();
+        auto move = test->get_last_move();
+        auto child = m_root->unlink_child(move);
+        if (!child) {
+            return false;
+        }
+        m_root = std::move(child);
+    }
+    // The side to move can be overridden by genmove.
+    return test->board.get_hash() == m_rootstate.board.get_hash()
+        && test->get_to_move() == m_rootstate.get_to_move();
+}
 
-    TTable::get_TT()->sync(hash, komi, node);
-    node->virtual_loss();
+void UCTSearch::update_root() {
+    m_playouts = 0;
+    m_batch_sims = 0;
+    m_cant_prune = false;
+    if (advance_to_new_rootstate() && m_root->get_visits() > 0) {
+        m_nodes = m_root->count_nodes();
+        m_inherited_playouts = m_root->get_visits();
+    } else {
+        m_root = std::make_unique<UCTNode>(FastBoard::PASS, 0.0f, 0.5f);
+        m_nodes = 0;
+        m_inherited_playouts = 0;
+    }
+    m_last_rootstate = std::make_unique<GameState>(m_rootstate);
+}
 
-    if (!node->has_children()) {
-        if (currstate.get_passes() >= 2) {
-            auto score = currstate.final_score();
-            result = SearchResult::from_score(score);
-        } else if (m_nodes < MAX_TREE_SIZE) {
-            float eval;
-            auto success = node->create_children(m_nodes, currstate, eval);
-            if (success) {
-                result = SearchResult::from_eval(eval);
-            }
-        } else {
-            auto eval = node->eval_state(currstate);
-            result = SearchResult::from_eval(eval);
+SearchResult UCTSearch::play_simulation(GameState & currstate, UCTNode* const node) {
+    auto sim = UCTSimulation{};
+    auto result = descend(currstate, node, sim);
+
+    if (sim.expanding) {
+        Network::Netresult raw_netlist;
+        {
+            SearchStats::Timer timer(SearchStats::NN_EVAL);
+            raw_netlist = Network::get_scored_moves(
+                &currstate, Network::Ensemble::RANDOM_ROTATION);
         }
+        result = expand(currstate, sim, raw_netlist);
+    }
+
+    backup(sim, result);
+    return result;
+}
+
+bool UCTSearch::start_simulation(UCTSimulation & sim,
+                                 const GameState & rootstate,
+                                 UCTNode * root) {
+    sim.state = std::make_unique<GameState>(rootstate);
+    auto result = descend(*sim.state, root, sim);
+
+    if (sim.expanding) {
+        sim.netresult = Network::get_scored_moves_async(
+            sim.state.get(), Network::Ensemble::RANDOM_ROTATION);
+        return true;
+    }
+
+    backup(sim, result);
+    if (result.valid()) {
+        increment_playouts();
     }
+    return false;
+}
 
-    if (node->has_children() && !result.valid()) {
-        auto next = node->uct_select_child(color);
+void UCTSearch::complete_simulation(UCTSimulation & sim) {
+    auto raw_netlist = sim.netresult.get();
+    auto result = expand(*sim.state, sim, raw_netlist);
+    backup(sim, result);
+    increment_playouts();
+}
 
-        if (next != nullptr) {
-            auto move = next->get_move();
+SearchResult UCTSearch::descend(GameState & currstate, UCTNode * node,
+                                UCTSimulation & sim) {
+    const auto komi = currstate.get_komi();
+    sim.path.clear();
+    sim.expanding = false;
 
-            if (move != FastBoard::PASS) {
-                currstate.play_move(move);
+    for (;;) {
+        const auto color = currstate.get_to_move();
+        // Rotated and mirrored transpositions share one TT entry.
+        const auto hash = currstate.board.get_canonical_hash();
 
-                if (!currstate.superko()) {
-                    result = play_simulation(currstate, next);
-                } else {
-                    next->invalidate();
+        {
+            SearchStats::Timer timer(SearchStats::TT_SYNC);
+            TTable::get_TT()->sync(hash, komi, node);
+        }
+        node->virtual_loss();
+        sim.path.emplace_back(node, hash);
+
+        if (!node->has_children()) {
+            if (currstate.get_passes() >= 2) {
+                auto score = currstate.final_score();
+                return SearchResult::from_score(score);
+            } else if (!tree_full()) {
+                if (node->acquire_expansion(currstate)) {
+                    sim.expanding = true;
+                    return SearchResult{};
                 }
             } else {
-                currstate.play_pass();
-                result = play_simulation(currstate, next);
+                auto eval = node->eval_state(currstate);
+                return SearchResult::from_eval(eval);
             }
         }
-    }
 
-    if (result.valid()) {
-        node->update(result.eval());
+        if (!node->has_children()) {
+            return SearchResult{};
+        }
+
+        UCTNode * next;
+        {
+            SearchStats::Timer timer(SearchStats::SELECTION);
+            next = node->uct_select_child(color);
+        }
+
+        if (next == nullptr) {
+            return SearchResult{};
+        }
+
+        auto move = next->get_move();
+        if (move != FastBoard::PASS) {
+            currstate.play_move(move);
+
+            if (currstate.superko()) {
+                next->invalidate();
+                return SearchResult{};
+            }
+        } else {
+            currstate.play_pass();
+        }
+        node = next;
     }
-    node->virtual_loss_undo();
-    TTable::get_TT()->update(hash, komi, node);
+}
 
-    return result;
+SearchResult UCTSearch::expand(GameState & currstate, UCTSimulation & sim,
+                               const Network::Netresult & raw_netlist) {
+    assert(sim.expanding);
+    auto leaf = sim.path.back().first;
+    auto eval = leaf->finish_expansion(m_nodes, currstate, raw_netlist);
+    sim.expanding = false;
+    return SearchResult::from_eval(eval);
+}
+
+void UCTSearch::backup(UCTSimulation & sim, const SearchResult & result) {
+    const auto komi = m_rootstate.get_komi();
+
+    for (auto it = sim.path.rbegin(); it != sim.path.rend(); ++it) {
+        auto node = it->first;
+        {
+            SearchStats::Timer timer(SearchStats::BACKUP);
+            if (result.valid()) {
+                node->backup(result.eval());
+            } else {
+                node->virtual_loss_undo();
+            }
+        }
+        {
+            SearchStats::Timer timer(SearchStats::TT_UPDATE);
+            TTable::get_TT()->update(it->second, komi, node);
+        }
+    }
+    sim.path.clear();
 }
 
 void UCTSearch::dump_stats(KoState & state, UCTNode & parent) {
@@ -111,7 +251,7 @@ void UCTSearch::dump_stats(KoState & state, UCTNode & parent) {
     const int color = state.get_to_move();
 
     // sort children, put best move on top
-    m_root.sort_root_children(color);
+    m_root->sort_root_children(color);
 
     UCTNode * bestnode = parent.get_first_child();
 
@@ -149,31 +289,31 @@ int UCTSearch::get_best_move(passflag_t passflag) {
     int color = m_rootstate.board.get_to_move();
 
     // Make sure best is first
-    m_root.sort_root_children(color);
+    m_root->sort_root_children(color);
 
     // Check whether to randomize the best move proportional
     // to the playout counts, early game only.
     auto movenum = int(m_rootstate.get_movenum());
     if (movenum < cfg_random_cnt) {
-        m_root.randomize_first_proportionally();
+        m_root->randomize_first_proportionally();
     }
 
-    int bestmove = m_root.get_first_child()->get_move();
+    int bestmove = m_root->get_first_child()->get_move();
 
     // do we have statistics on the moves?
-    if (m_root.get_first_child() != nullptr) {
-        if (m_root.get_first_child()->first_visit()) {
+    if (m_root->get_first_child() != nullptr) {
+        if (m_root->get_first_child()->first_visit()) {
             return bestmove;
         }
     }
 
-    float bestscore = m_root.get_first_child()->get_eval(color);
+    float bestscore = m_root->get_first_child()->get_eval(color);
 
     // do we want to fiddle with the best move because of the rule set?
     if (passflag & UCTSearch::NOPASS) {
         // were we going to pass?
         if (bestmove == FastBoard::PASS) {
-            UCTNode * nopass = m_root.get_nopass_child(m_rootstate);
+            UCTNode * nopass = m_root->get_nopass_child(m_rootstate);
 
             if (nopass != nullptr) {
                 myprintf("Preferring not to pass.\n");
@@ -214,7 +354,7 @@ int UCTSearch::get_best_move(passflag_t passflag) {
                 (score < 0.0f && color == FastBoard::BLACK)) {
                 myprintf("Passing loses :-(\n");
                 // Find a valid non-pass move.
-                UCTNode * nopass = m_root.get_nopass_child(m_rootstate);
+                UCTNode * nopass = m_root->get_nopass_child(m_rootstate);
                 if (nopass != nullptr) {
                     myprintf("Avoiding pass because it loses.\n");
                     bestmove = nopass->get_move();
@@ -247,7 +387,7 @@ int UCTSearch::get_best_move(passflag_t passflag) {
         }
     }
 
-    int visits = m_root.get_visits();
+    int visits = m_root->get_visits();
 
     // if we aren't passing, should we consider resigning?
     if (bestmove != FastBoard::PASS) {
@@ -294,28 +434,264 @@ void UCTSearch::dump_analysis(int playouts) {
     GameState tempstate = m_rootstate;
     int color = tempstate.board.get_to_move();
 
-    std::string pvstring = get_pv(tempstate, m_root);
-    float winrate = 100.0f * m_root.get_eval(color);
+    std::string pvstring = get_pv(tempstate, *m_root);
+    float winrate = 100.0f * m_root->get_eval(color);
     myprintf("Playouts: %d, Win: %5.2f%%, PV: %s\n",
              playouts, winrate, pvstring.c_str());
 }
 
+int UCTSearch::est_playouts_left(int elapsed_centis, int time_for_move) const {
+    auto playouts = m_playouts.load();
+    auto playouts_left = std::max(0, m_maxplayouts - playouts
+                                     - m_inherited_playouts);
+    // Wait for a usable measurement of the playout rate.
+    if (time_for_move < 0 || elapsed_centis < 10 || playouts < 100) {
+        return playouts_left;
+    }
+    // Assume each root parallel worker searches as fast as we do.
+    auto playout_rate = double(playouts) * (1 + RootParallel::num_workers())
+                        / elapsed_centis;
+    auto time_left = std::max(0, time_for_move - elapsed_centis);
+    return std::min(playouts_left,
+                    static_cast<int>(std::ceil(playout_rate * time_left)));
+}
+
+bool UCTSearch::have_alternate_moves(int playouts_left) {
+    if (!cfg_smart_stop) {
+        return true;
+    }
+    // The move with the most visits gets played. Stop when no other
+    // move can catch up with it in the playouts we have left.
+    auto best = 0;
+    auto second = 0;
+    for (auto child = m_root->get_first_child(); child != nullptr;
+         child = child->get_sibling()) {
+        if (!child->valid()) {
+            continue;
+        }
+        auto visits = child->get_visits();
+        if (visits > best) {
+            second = best;
+            best = visits;
+        } else if (visits > second) {
+            second = visits;
+        }
+    }
+    return best - second <= playouts_left;
+}
+
+bool UCTSearch::tree_full() const {
+    return m_nodes >= m_maxnodes;
+}
+
+bool UCTSearch::need_prune() const {
+    return tree_full() && !m_cant_prune;
+}
+
+void UCTSearch::prune_tree(ThreadGroup & workers) {
+    // Stop the workers while we delete nodes under them.
+    m_pause = true;
+    workers.wait_all();
+
+    // Leave room for growth, so we don't have to prune again right away.
+    auto target = m_maxnodes / 4 * 3;
+    auto min_visits = 2;
+    while (m_nodes > target && min_visits <= m_root->get_visits()) {
+        m_nodes -= m_root->prune(min_visits);
+        min_visits *= 2;
+    }
+    myprintf("Tree memory full, pruned to %d nodes (%d MiB).\n",
+             static_cast<int>(m_nodes),
+             static_cast<int>((m_nodes * UCTNode::allocated_size()) >> 20));
+    // The root children are never pruned, so we can get stuck above
+    // the target. Evaluate leaves without expanding them until the next
+    // move then, instead of pruning again after every step.
+    if (m_nodes > target) {
+        myprintf("Can't prune further, not expanding until the next move.\n");
+        m_cant_prune = true;
+    }
+
+    m_pause = false;
+    // Don't restart the workers if we were stopped meanwhile.
+    if (is_running()) {
+        add_workers(workers);
+    }
+}
+
+void UCTSearch::start_workers(ThreadGroup & workers) {
+    m_run = true;
+    add_workers(workers);
+}
+
+void UCTSearch::add_workers(ThreadGroup & workers) {
+    // Deterministic searches play their batches on the search thread.
+    if (!cfg_deterministic) {
+        workers.add_tasks(cfg_num_threads,
+                          UCTWorker(m_rootstate, this, m_root.get()));
+    }
+}
+
+void UCTSearch::search_step() {
+    if (cfg_deterministic) {
+        play_batch();
+    } else {
+        wait_for_stop(std::chrono::milliseconds(10));
+    }
+}
+
+/*
+    One batch of cfg_num_threads simulations, always in the same order.
+    The descents run one after another, so each sees the virtual
+    losses of the ones before it. Only the network evaluations run in
+    parallel, each with a rotation from its own random stream. The
+    results are then backed up in order, so the tree doesn't depend on
+    which thread finished first.
+*/
+void UCTSearch::play_batch() {
+    if (!is_running()) {
+        return;
+    }
+    if (playout_limit_reached()) {
+        stop();
+        return;
+    }
+
+    auto sims = std::vector<UCTSimulation>(cfg_num_threads);
+    auto results = std::vector<SearchResult>(sims.size());
+    for (auto i = size_t{0}; i < sims.size(); i++) {
+        auto & sim = sims[i];
+        sim.state = std::make_unique<GameState>(m_rootstate);
+        results[i] = descend(*sim.state, m_root.get(), sim);
+        if (sim.expanding) {
+            auto rng = Random{cfg_rng_seed ^ m_rootstate.board.get_hash()
+                              ^ (m_batch_sims++ * 0x9E3779B97F4A7C15ULL)};
+            auto rotation = static_cast<int>(rng.randuint32(8));
+            auto state = sim.state.get();
+            sim.netresult = thread_pool.add_task([state, rotation]() {
+                SearchStats::Timer timer(SearchStats::NN_EVAL);
+                return Network::get_scored_moves(
+                    state, Network::Ensemble::DIRECT, rotation);
+            });
+        }
+    }
+
+    for (auto i = size_t{0}; i < sims.size(); i++) {
+        auto & sim = sims[i];
+        if (sim.expanding) {
+            auto raw_netlist = sim.netresult.get();
+            results[i] = expand(*sim.state, sim, raw_netlist);
+        }
+        backup(sim, results[i]);
+        if (results[i].valid()) {
+            increment_playouts();
+        }
+    }
+}
+
 bool UCTSearch::is_running() const {
     return m_run;
 }
 
+bool UCTSearch::is_paused() const {
+    return m_pause;
+}
+
+void UCTSearch::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_stop_mutex);
+        m_run = false;
+    }
+    m_stop_cv.notify_all();
+}
+
+void UCTSearch::wait_for_stop(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_stop_mutex);
+    m_stop_cv.wait_for(lock, timeout, [this]() { return !m_run; });
+}
+
 bool UCTSearch::playout_limit_reached() const {
-    return m_playouts >= m_maxplayouts;
+    return m_playouts >= m_maxplayouts - m_inherited_playouts;
+}
+
+int UCTSearch::get_playouts() const {
+    return m_playouts;
+}
+
+int UCTSearch::get_nodes() const {
+    return m_nodes;
 }
 
 void UCTWorker::operator()() {
+    if (cfg_sims_per_thread > 1) {
+        run_inflight();
+        return;
+    }
     do {
         auto currstate = std::make_unique<GameState>(m_rootstate);
         auto result = m_search->play_simulation(*currstate, m_root);
         if (result.valid()) {
             m_search->increment_playouts();
         }
-    } while(m_search->is_running() && !m_search->playout_limit_reached());
+    } while(m_search->is_running() && !m_search->is_paused()
+            && !m_search->playout_limit_reached());
+    if (m_search->playout_limit_reached()) {
+        // Wake up the search thread.
+        m_search->stop();
+    }
+}
+
+/*
+    Keep cfg_sims_per_thread simulations going, starting a new one
+    whenever one finishes. Everything still waiting on the network
+    is completed before returning, so no node is left expanding and
+    no virtual loss is left behind when the tree changes.
+*/
+void UCTWorker::run_inflight() {
+    auto sims = std::vector<UCTSimulation>(cfg_sims_per_thread);
+    auto running = [this]() {
+        return m_search->is_running() && !m_search->is_paused()
+               && !m_search->playout_limit_reached();
+    };
+
+    for (;;) {
+        auto waiting = 0;
+        auto progress = false;
+        UCTSimulation * oldest = nullptr;
+
+        for (auto & sim : sims) {
+            if (sim.netresult.valid()) {
+                auto status = sim.netresult.wait_for(std::chrono::seconds(0));
+                if (status != std::future_status::ready) {
+                    waiting++;
+                    if (oldest == nullptr) {
+                        oldest = &sim;
+                    }
+                    continue;
+                }
+                m_search->complete_simulation(sim);
+                progress = true;
+            }
+            if (running()) {
+                if (m_search->start_simulation(sim, m_rootstate, m_root)) {
+                    waiting++;
+                    progress = true;
+                }
+            }
+        }
+
+        if (waiting == 0 && !running()) {
+            break;
+        }
+        // Nothing to do but wait for the network.
+        if (!progress && oldest != nullptr) {
+            oldest->netresult.wait();
+        }
+    }
+
+    if (m_search->playout_limit_reached()) {
+        // Wake up the search thread.
+        m_search->stop();
+    }
 }
 
 void UCTSearch::increment_playouts() {
@@ -323,51 +699,63 @@ void UCTSearch::increment_playouts() {
 }
 
 int UCTSearch::think(int color, passflag_t passflag) {
-    assert(m_playouts == 0);
-    assert(m_nodes == 0);
-
     // Start counting time for us
     m_rootstate.start_clock(color);
 
     // set side to move
     m_rootstate.board.set_to_move(color);
 
+    update_root();
+    if (m_inherited_playouts > 0) {
+        myprintf("Reusing %d visits, %d nodes from the previous search.\n",
+                 m_inherited_playouts, static_cast<int>(m_nodes));
+    }
+
     // set up timing info
     Time start;
 
     m_rootstate.get_timecontrol().set_boardsize(m_rootstate.board.get_boardsize());
     auto time_for_move = m_rootstate.get_timecontrol().max_time_for_move(color);
 
+    // Visits we inherited stand for time we don't need to spend again.
+    if (m_inherited_playouts > 0 && m_last_nps > 0) {
+        auto inherited_time = (m_inherited_playouts * 100) / m_last_nps;
+        time_for_move = std::max(0, time_for_move - inherited_time);
+    }
+
     myprintf("Thinking at most %.1f seconds...\n", time_for_move/100.0f);
 
     // create a sorted list off legal moves (make sure we
     // play something legal and decent even in time trouble)
     float root_eval;
-    m_root.create_children(m_nodes, m_rootstate, root_eval);
-    m_root.kill_superkos(m_rootstate);
+    if (!m_root->create_children(m_nodes, m_rootstate, root_eval)) {
+        root_eval = m_root->get_eval(FastBoard::BLACK);
+    }
+    m_root->kill_superkos(m_rootstate);
     if (cfg_noise) {
-        m_root.dirichlet_noise(0.25f, 0.03f);
+        m_root->dirichlet_noise(0.25f, 0.03f);
     }
 
     myprintf("NN eval=%f\n",
              (color == FastBoard::BLACK ? root_eval : 1.0f - root_eval));
 
-    m_run = true;
-    int cpus = cfg_num_threads;
+    const auto stats_start = SearchStats::collect();
+    RootParallel::start_search(m_rootstate);
+
+    // All the searching happens on the workers, this thread only
+    // decides when to stop.
     ThreadGroup tg(thread_pool);
-    for (int i = 1; i < cpus; i++) {
-        tg.add_task(UCTWorker(m_rootstate, this, &m_root));
-    }
+    start_workers(tg);
 
     bool keeprunning = true;
     int last_update = 0;
     do {
-        auto currstate = std::make_unique<GameState>(m_rootstate);
+        search_step();
 
-        auto result = play_simulation(*currstate, &m_root);
-        if (result.valid()) {
-            increment_playouts();
+        if (need_prune()) {
+            prune_tree(tg);
         }
+        RootParallel::merge(*m_root);
 
         Time elapsed;
         int centiseconds_elapsed = Time::timediff(start, elapsed);
@@ -381,61 +769,117 @@ int UCTSearch::think(int color, passflag_t passflag) {
         keeprunning  = is_running();
         keeprunning &= (centiseconds_elapsed < time_for_move);
         keeprunning &= !playout_limit_reached();
+        if (keeprunning) {
+            // Only stop early to save time for later moves. If the time
+            // is lost anyway, we might as well use it. Playout limited
+            // searches (self-play) and random opening moves always search
+            // to the end, as their visit counts are recorded for training
+            // and sampled from.
+            auto& tc = m_rootstate.get_timecontrol();
+            auto movenum = int(m_rootstate.get_movenum());
+            if (tc.can_accumulate_time(color)
+                && m_maxplayouts == std::numeric_limits<int>::max()
+                && movenum >= cfg_random_cnt) {
+                // The time based estimate would make deterministic
+                // searches stop at a different point every run.
+                auto playouts_left = est_playouts_left(
+                    centiseconds_elapsed,
+                    cfg_deterministic ? -1 : time_for_move);
+                if (!have_alternate_moves(playouts_left)) {
+                    myprintf("Best move can't change with %d playouts "
+                             "left, stopping early.\n", playouts_left);
+                    keeprunning = false;
+                }
+            }
+        }
     } while(keeprunning);
 
     // stop the search
-    m_run = false;
+    stop();
     tg.wait_all();
+    RootParallel::stop_search(*m_root);
     m_rootstate.stop_clock(color);
-    if (!m_root.has_children()) {
+    if (!m_root->has_children()) {
         return FastBoard::PASS;
     }
 
     // display search info
     myprintf("\n");
 
-    dump_stats(m_rootstate, m_root);
-    Training::record(m_rootstate, m_root);
+    dump_stats(m_rootstate, *m_root);
+    Training::record(m_rootstate, *m_root);
 
     Time elapsed;
     int centiseconds_elapsed = Time::timediff(start, elapsed);
     if (centiseconds_elapsed > 0) {
         myprintf("%d visits, %d nodes, %d playouts, %d n/s\n\n",
-                 m_root.get_visits(),
+                 m_root->get_visits(),
                  static_cast<int>(m_nodes),
                  static_cast<int>(m_playouts),
                  (m_playouts * 100) / (centiseconds_elapsed+1));
+        // Inherited visits include those merged from root parallel
+        // workers, so count their speed too.
+        m_last_nps = (m_playouts * 100 * (1 + RootParallel::num_workers()))
+                     / (centiseconds_elapsed+1);
+    }
+    if (SearchStats::enabled()) {
+        auto stats = SearchStats::collect() - stats_start;
+        myprintf("%s\n\n", SearchStats::summary(stats, m_playouts).c_str());
     }
     int bestmove = get_best_move(passflag);
     return bestmove;
 }
 
 void UCTSearch::ponder() {
-    assert(m_playouts == 0);
-    assert(m_nodes == 0);
+    update_root();
 
-    m_run = true;
-    int cpus = cfg_num_threads;
     ThreadGroup tg(thread_pool);
-    for (int i = 1; i < cpus; i++) {
-        tg.add_task(UCTWorker(m_rootstate, this, &m_root));
-    }
-    do {
-        auto currstate = std::make_unique<GameState>(m_rootstate);
-        auto result = play_simulation(*currstate, &m_root);
-        if (result.valid()) {
-            increment_playouts();
+    start_workers(tg);
+    // Stop as soon as the next command comes in.
+    Utils::set_input_callback([this]() { stop(); });
+    while (!Utils::input_pending() && is_running()
+           && !playout_limit_reached()
+           && have_alternate_moves(est_playouts_left(0, -1))) {
+        search_step();
+        if (need_prune()) {
+            prune_tree(tg);
         }
-    } while(!Utils::input_pending() && is_running());
+    }
+    Utils::set_input_callback(nullptr);
 
     // stop the search
-    m_run = false;
+    stop();
     tg.wait_all();
     // display search info
     myprintf("\n");
-    dump_stats(m_rootstate, m_root);
+    dump_stats(m_rootstate, *m_root);
+
+    myprintf("\n%d visits, %d nodes\n\n", m_root->get_visits(), (int)m_nodes);
+}
+
+void UCTSearch::search_until_stopped(
+    std::chrono::milliseconds interval,
+    const std::function<void(UCTNode&)> & report) {
+    update_root();
+
+    ThreadGroup tg(thread_pool);
+    start_workers(tg);
+    auto last_report = std::chrono::steady_clock::now();
+    while (is_running()) {
+        search_step();
+        if (need_prune()) {
+            prune_tree(tg);
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_report >= interval) {
+            report(*m_root);
+            last_report = now;
+        }
+    }
 
-    myprintf("\n%d visits, %d nodes\n\n", m_root.get_visits(), (int)m_nodes);
+    stop();
+    tg.wait_all();
+    report(*m_root);
 }
 
 void UCTSearch::set_playout_limit(int playouts) {
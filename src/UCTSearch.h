@@ -21,10 +21,19 @@
 
 #include <memory>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <tuple>
+#include <utility>
+#include <vector>
 
 #include "GameState.h"
+#include "Network.h"
 #include "UCTNode.h"
+#include "ThreadPool.h"
 
 class SearchResult {
 public:
@@ -50,6 +59,19 @@ private:
     float m_eval{0.0f};
 };
 
+/*
+    A simulation that can be suspended while the network evaluates
+    its leaf. path holds the nodes visited from the root, with the
+    hash of each position for the TT update on the way back up.
+*/
+struct UCTSimulation {
+    std::unique_ptr<GameState> state;
+    std::vector<std::pair<UCTNode*, uint64>> path;
+    // The last node in path is waiting for its children.
+    bool expanding{false};
+    std::future<Network::Netresult> netresult;
+};
+
 class UCTSearch {
 public:
     /*
@@ -63,33 +85,82 @@ public:
     static constexpr passflag_t NORESIGN = 1 << 1;
 
     /*
-        Maximum size of the tree in memory. Nodes are about
-        40 bytes, so limit to ~1.6G.
+        Default memory budget for the tree, about 32M nodes of 56 bytes
+        plus 8 bytes of glibc malloc overhead each.
+        When the tree grows past it, the least visited subtrees are
+        pruned back to leaves.
     */
-    static constexpr auto MAX_TREE_SIZE = 40'000'000;
+    static constexpr size_t DEFAULT_MAX_TREE_MEMORY = size_t{2048} * 1024 * 1024;
 
     UCTSearch(GameState & g);
+    const GameState & get_rootstate() const;
+    // Reuse the part of the tree that matches the current position.
+    void update_root();
     int think(int color, passflag_t passflag = NORMAL);
     void set_playout_limit(int playouts);
     void set_analyzing(bool flag);
     void set_quiet(bool flag);
     void ponder();
+    // Search until stop(), passing the root to report() every interval.
+    void search_until_stopped(std::chrono::milliseconds interval,
+                              const std::function<void(UCTNode&)> & report);
     bool is_running() const;
+    // Workers leave their loop while the tree is being pruned.
+    bool is_paused() const;
+    void stop();
     bool playout_limit_reached() const;
+    int get_playouts() const;
+    int get_nodes() const;
     void increment_playouts();
     SearchResult play_simulation(GameState & currstate, UCTNode * const node);
+    // Returns true if the simulation is now waiting for the network.
+    bool start_simulation(UCTSimulation & sim, const GameState & rootstate,
+                          UCTNode * root);
+    void complete_simulation(UCTSimulation & sim);
 
 private:
+    SearchResult descend(GameState & currstate, UCTNode * node,
+                         UCTSimulation & sim);
+    SearchResult expand(GameState & currstate, UCTSimulation & sim,
+                        const Network::Netresult & raw_netlist);
+    void backup(UCTSimulation & sim, const SearchResult & result);
     void dump_stats(KoState & state, UCTNode & parent);
     std::string get_pv(KoState & state, UCTNode & parent);
     void dump_analysis(int playouts);
     int get_best_move(passflag_t passflag);
+    bool tree_full() const;
+    bool need_prune() const;
+    void prune_tree(Utils::ThreadGroup & workers);
+    void start_workers(Utils::ThreadGroup & workers);
+    void add_workers(Utils::ThreadGroup & workers);
+    void search_step();
+    void play_batch();
+    void wait_for_stop(std::chrono::milliseconds timeout);
+    int est_playouts_left(int elapsed_centis, int time_for_move) const;
+    bool have_alternate_moves(int playouts_left);
+
+    bool advance_to_new_rootstate();
 
     GameState & m_rootstate;
-    UCTNode m_root{FastBoard::PASS, 0.0f, 0.5f};
+    std::unique_ptr<UCTNode> m_root;
+    // Position the tree was last searched for.
+    std::unique_ptr<GameState> m_last_rootstate;
     std::atomic<int> m_nodes{0};
+    int m_maxnodes;
+    // Pruning couldn't make room, stop expanding until the next move.
+    bool m_cant_prune{false};
     std::atomic<int> m_playouts{0};
+    // Root visits carried over from earlier searches.
+    int m_inherited_playouts{0};
+    int m_last_nps{0};
+    // Simulations started by deterministic batches this search.
+    uint64 m_batch_sims{0};
     std::atomic<bool> m_run{false};
+    // Kept apart from m_run, so a stop() during pruning isn't lost.
+    std::atomic<bool> m_pause{false};
+    // The search thread sleeps on this while the workers search.
+    std::mutex m_stop_mutex;
+    std::condition_variable m_stop_cv;
     int m_maxplayouts;
 };
 
@@ -99,6 +170,7 @@ public:
       : m_rootstate(state), m_search(search), m_root(root) {}
     void operator()();
 private:
+    void run_inflight();
     GameState & m_rootstate;
     UCTSearch * m_search;
     UCTNode * m_root;
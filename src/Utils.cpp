@@ -23,75 +23,74 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
-#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <mutex>
-#ifdef _WIN32
-#include <windows.h>
-#else
-#include <sys/select.h>
-#endif
+#include <thread>
 
 #include "Utils.h"
 #include "GTP.h"
+#include "SMP.h"
 
 Utils::ThreadPool thread_pool;
 
-bool Utils::input_pending(void) {
-#ifdef HAVE_SELECT
-    fd_set read_fds;
-    struct timeval timeout;
-    FD_ZERO(&read_fds);
-    FD_SET(0,&read_fds);
-    timeout.tv_sec = timeout.tv_usec = 0;
-    select(1,&read_fds,NULL,NULL,&timeout);
-    if (FD_ISSET(0,&read_fds)) {
-        return true;
-    } else {
-        return false;
-    }
-#else
-    static int init = 0, pipe;
-    static HANDLE inh;
-    DWORD dw;
-
-    if (!init) {
-        init = 1;
-        inh = GetStdHandle(STD_INPUT_HANDLE);
-        pipe = !GetConsoleMode(inh, &dw);
-        if (!pipe) {
-            SetConsoleMode(inh, dw & ~(ENABLE_MOUSE_INPUT | ENABLE_WINDOW_INPUT));
-            FlushConsoleInputBuffer(inh);
+namespace {
+    // Lines read from stdin by the input thread.
+    std::mutex input_mutex;
+    std::condition_variable input_cv;
+    std::deque<std::string> input_queue;
+    bool input_eof = false;
+    std::function<void()> input_callback;
+
+    void queue_input(std::string * line) {
+        std::lock_guard<std::mutex> lock(input_mutex);
+        if (line) {
+            input_queue.emplace_back(std::move(*line));
+        } else {
+            input_eof = true;
+        }
+        // Called under the lock, so that it can't run any more
+        // once it has been unset.
+        if (input_callback) {
+            input_callback();
         }
+        input_cv.notify_one();
     }
+}
 
-    if (pipe) {
-        if (!PeekNamedPipe(inh, NULL, 0, NULL, &dw, NULL)) {
-            myprintf("Nothing at other end - exiting\n");
-            exit(EXIT_FAILURE);
+void Utils::start_input_reader() {
+    std::thread([]() {
+        auto line = std::string{};
+        while (std::getline(std::cin, line)) {
+            queue_input(&line);
         }
+        queue_input(nullptr);
+    }).detach();
+}
 
-        if (dw) {
-            return true;
-        } else {
-            return false;
-        }
-    } else {
-        if (!GetNumberOfConsoleInputEvents(inh, &dw)) {
-            myprintf("Nothing at other end - exiting\n");
-            exit(EXIT_FAILURE);
-        }
+bool Utils::input_pending(void) {
+    std::lock_guard<std::mutex> lock(input_mutex);
+    return !input_queue.empty() || input_eof;
+}
 
-        if (dw <= 1) {
-            return false;
-        } else {
-            return true;
-        }
+bool Utils::read_input(std::string & line) {
+    std::unique_lock<std::mutex> lock(input_mutex);
+    input_cv.wait(lock, []() { return !input_queue.empty() || input_eof; });
+    if (input_queue.empty()) {
+        return false;
     }
-    return false;
-#endif
+    line = std::move(input_queue.front());
+    input_queue.pop_front();
+    return true;
+}
+
+void Utils::set_input_callback(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(input_mutex);
+    input_callback = std::move(callback);
 }
 
-static std::mutex IOmutex;
+static SMP::Mutex IOmutex;
 
 void Utils::myprintf(const char *fmt, ...) {
     if (cfg_quiet) return;
@@ -101,7 +100,7 @@ void Utils::myprintf(const char *fmt, ...) {
     va_end(ap);
 
     if (cfg_logfile_handle) {
-        std::lock_guard<std::mutex> lock(IOmutex);
+        LOCK(IOmutex, lock);
         va_start(ap, fmt);
         vfprintf(cfg_logfile_handle, fmt, ap);
         va_end(ap);
@@ -123,7 +122,7 @@ void Utils::gtp_printf(int id, const char *fmt, ...) {
     printf("\n\n");
 
     if (cfg_logfile_handle) {
-        std::lock_guard<std::mutex> lock(IOmutex);
+        LOCK(IOmutex, lock);
         if (id != -1) {
             fprintf(cfg_logfile_handle, "=%d ", id);
         } else {
@@ -151,7 +150,7 @@ void Utils::gtp_fail_printf(int id, const char *fmt, ...) {
     printf("\n\n");
 
     if (cfg_logfile_handle) {
-        std::lock_guard<std::mutex> lock(IOmutex);
+        LOCK(IOmutex, lock);
         if (id != -1) {
             fprintf(cfg_logfile_handle, "?%d ", id);
         } else {
@@ -166,7 +165,7 @@ void Utils::gtp_fail_printf(int id, const char *fmt, ...) {
 
 void Utils::log_input(std::string input) {
     if (cfg_logfile_handle) {
-        std::lock_guard<std::mutex> lock(IOmutex);
+        LOCK(IOmutex, lock);
         fprintf(cfg_logfile_handle, ">>%s\n", input.c_str());
     }
 }
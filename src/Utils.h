@@ -22,6 +22,7 @@
 #include "config.h"
 #include <string>
 #include <atomic>
+#include <functional>
 #include "ThreadPool.h"
 
 extern Utils::ThreadPool thread_pool;
@@ -31,7 +32,16 @@ namespace Utils {
     void gtp_printf(int id, const char *fmt, ...);
     void gtp_fail_printf(int id, const char *fmt, ...);
     void log_input(std::string input);
+
+    /*
+        Standard input is read by a separate thread into a queue.
+        The callback, if set, runs on that thread whenever a line
+        arrives, so a search can stop right away.
+    */
+    void start_input_reader();
     bool input_pending();
+    bool read_input(std::string & line);
+    void set_input_callback(std::function<void()> callback);
 
     template<class T>
     void atomic_add(std::atomic<T> &f, T d) {
@@ -0,0 +1,539 @@
+/*
+    This file is part of Leela Zero.
+    Copyright (C) 2017 Gian-Carlo Pascutto
+
+    Leela Zero is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Leela Zero is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Leela Zero.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Micro-benchmarks for the engine hot paths.
+
+    Every benchmark uses fixed seeds and fixed amounts of work, so that
+    results from different builds can be compared directly. Results are
+    written to stdout as CSV, one line per benchmark:
+
+        name,ops,ns_per_op_median,ns_per_op_min,ops_per_sec
+
+    Anything else (progress, network initialization) goes to stderr.
+*/
+
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include "BitBoard.h"
+#include "FastBoard.h"
+#include "FullBoard.h"
+#include "GameState.h"
+#include "GTP.h"
+#include "KoState.h"
+#include "Network.h"
+#include "Random.h"
+#include "SGFParser.h"
+#include "SGFTree.h"
+#include "TTable.h"
+#include "Training.h"
+#include "UCTNode.h"
+#include "Utils.h"
+#include "Zobrist.h"
+
+using namespace Utils;
+
+namespace {
+
+// Seed for everything random in here. Changing it invalidates
+// comparisons with older results.
+constexpr uint64 BENCH_SEED = 0x6c65656c617a6231ULL;
+
+using movelist_t = std::vector<std::pair<int, int>>;
+
+// A benchmark runs a batch of work and returns the number of
+// operations it performed.
+using batch_t = std::function<size_t()>;
+
+volatile size_t g_sink = 0;
+
+struct BenchConfig {
+    int repeat{5};
+    std::string filter;
+};
+
+void run_bench(const BenchConfig& config, const std::string& name,
+               batch_t batch) {
+    if (!config.filter.empty()
+        && name.find(config.filter) == std::string::npos) {
+        return;
+    }
+
+    // Warm up caches and branch predictors.
+    batch();
+
+    auto ops = size_t{0};
+    auto samples = std::vector<double>{};
+    for (auto i = 0; i < config.repeat; i++) {
+        auto start = std::chrono::steady_clock::now();
+        ops = batch();
+        auto end = std::chrono::steady_clock::now();
+        auto ns = std::chrono::duration<double, std::nano>(end - start).count();
+        samples.emplace_back(ns / std::max<size_t>(ops, 1));
+    }
+    std::sort(begin(samples), end(samples));
+    auto median = samples[samples.size() / 2];
+    auto fastest = samples.front();
+
+    printf("%s,%zu,%.1f,%.1f,%.0f\n", name.c_str(), ops, median, fastest,
+           median > 0.0 ? 1e9 / median : 0.0);
+    fflush(stdout);
+}
+
+// Plays a game of random moves that don't fill own eyes, stopping
+// after two passes or maxmoves moves.
+movelist_t random_game(Random& rng, int maxmoves) {
+    auto moves = movelist_t{};
+    auto state = KoState{};
+    state.init_game(19, 7.5f);
+
+    while (state.get_passes() < 2 && (int)moves.size() < maxmoves) {
+        auto color = state.get_to_move();
+        auto candidates = state.generate_moves(color);
+        candidates.erase(std::remove_if(begin(candidates), end(candidates),
+            [&state, color](int vtx) {
+                return vtx == FastBoard::PASS
+                       || state.board.is_eye(color, vtx);
+            }), end(candidates));
+
+        auto move = int{FastBoard::PASS};
+        while (!candidates.empty()) {
+            auto idx = rng.randuint32(candidates.size());
+            auto tmp = state;
+            tmp.play_move(color, candidates[idx]);
+            if (!tmp.superko()) {
+                move = candidates[idx];
+                break;
+            }
+            candidates.erase(begin(candidates) + idx);
+        }
+        state.play_move(color, move);
+        moves.emplace_back(color, move);
+    }
+
+    return moves;
+}
+
+GameState replay(const movelist_t& moves, size_t count) {
+    auto state = GameState{};
+    state.init_game(19, 7.5f);
+    for (auto i = size_t{0}; i < std::min(count, moves.size()); i++) {
+        state.play_move(moves[i].first, moves[i].second);
+    }
+    return state;
+}
+
+void bench_board(const BenchConfig& config, const std::vector<movelist_t>& games) {
+    run_bench(config, "fullboard_update_board", [&games]() {
+        auto ops = size_t{0};
+        auto board = FullBoard{};
+        for (const auto& game : games) {
+            board.reset_board(19);
+            for (const auto& move : game) {
+                if (move.second == FastBoard::PASS) {
+                    continue;
+                }
+                auto capture = false;
+                g_sink += board.update_board(move.first, move.second, capture);
+                ops++;
+            }
+        }
+        return ops;
+    });
+
+    // Positions to query, taken from the middle of the games.
+    auto positions = std::vector<GameState>{};
+    for (const auto& game : games) {
+        positions.emplace_back(replay(game, game.size() / 2));
+    }
+
+    run_bench(config, "fastboard_is_suicide", [&positions]() {
+        auto ops = size_t{0};
+        for (auto& pos : positions) {
+            for (auto vtx = 0; vtx < FastBoard::MAXSQ; vtx++) {
+                if (pos.board.get_square(vtx) != FastBoard::EMPTY) {
+                    continue;
+                }
+                g_sink += pos.board.is_suicide(vtx, FastBoard::BLACK);
+                g_sink += pos.board.is_suicide(vtx, FastBoard::WHITE);
+                ops += 2;
+            }
+        }
+        return ops;
+    });
+
+    run_bench(config, "faststate_generate_moves", [&positions]() {
+        auto ops = size_t{0};
+        for (auto& pos : positions) {
+            g_sink += pos.generate_moves(FastBoard::BLACK).size();
+            g_sink += pos.generate_moves(FastBoard::WHITE).size();
+            ops += 2;
+        }
+        return ops;
+    });
+
+    run_bench(config, "fastboard_area_score", [&positions]() {
+        auto ops = size_t{0};
+        for (auto& pos : positions) {
+            g_sink += static_cast<size_t>(pos.board.area_score(7.5f));
+            ops++;
+        }
+        return ops;
+    });
+
+    run_bench(config, "bitboard_dead_strings", [&positions]() {
+        auto ops = size_t{0};
+        for (auto& pos : positions) {
+            auto empty = pos.board.get_empty_bb();
+            for (auto color : {FastBoard::BLACK, FastBoard::WHITE}) {
+                auto dead = BitBoard::dead_strings(
+                    pos.board.get_stones_bb(color), empty);
+                g_sink += dead.count();
+                ops++;
+            }
+        }
+        return ops;
+    });
+
+    run_bench(config, "bitboard_reach_empty", [&positions]() {
+        auto ops = size_t{0};
+        for (auto& pos : positions) {
+            auto empty = pos.board.get_empty_bb();
+            auto black = pos.board.get_stones_bb(FastBoard::BLACK);
+            auto reach = BitBoard::flood_fill(black | black.neighbours(empty),
+                                              black | empty);
+            g_sink += reach.count();
+            ops++;
+        }
+        return ops;
+    });
+}
+
+void bench_superko(const BenchConfig& config, const std::vector<movelist_t>& games) {
+    // The cost of the superko check grows with the length of the game,
+    // so measure it at a few different game lengths.
+    for (auto movenum : { 50, 150, 300 }) {
+        auto states = std::vector<KoState>{};
+        for (const auto& game : games) {
+            if ((int)game.size() >= movenum) {
+                states.emplace_back(replay(game, movenum));
+            }
+        }
+        if (states.empty()) {
+            continue;
+        }
+        auto name = "kostate_superko_" + std::to_string(movenum);
+        run_bench(config, name, [&states]() {
+            auto ops = size_t{0};
+            for (auto rep = 0; rep < 100; rep++) {
+                for (const auto& state : states) {
+                    g_sink += state.superko();
+                    ops++;
+                }
+            }
+            return ops;
+        });
+    }
+}
+
+void bench_features(const BenchConfig& config, const std::vector<movelist_t>& games) {
+    auto positions = std::vector<GameState>{};
+    for (const auto& game : games) {
+        positions.emplace_back(replay(game, game.size() / 2));
+    }
+
+    run_bench(config, "network_gather_features", [&positions]() {
+        auto ops = size_t{0};
+        for (auto& pos : positions) {
+            auto planes = Network::NNPlanes{};
+            Network::gather_features(&pos, planes);
+            g_sink += planes[0].count();
+            ops++;
+        }
+        return ops;
+    });
+}
+
+void bench_uct(const BenchConfig& config) {
+    auto rng = Random{BENCH_SEED};
+    std::atomic<int> nodecount{0};
+    UCTNode root{FastBoard::PASS, 0.0f, 0.5f};
+    auto state = KoState{};
+    state.init_game(19, 7.5f);
+
+    // A root with a child for every move, with a policy and
+    // search statistics that look somewhat realistic.
+    auto nodelist = std::vector<Network::scored_node>{};
+    auto policy_sum = 0.0f;
+    for (auto vtx : state.generate_moves(FastBoard::BLACK)) {
+        auto prior = rng.randflt() * rng.randflt() * rng.randflt();
+        nodelist.emplace_back(prior, vtx);
+        policy_sum += prior;
+    }
+    for (auto& node : nodelist) {
+        node.first /= policy_sum;
+    }
+    root.link_nodelist(nodecount, nodelist, 0.5f);
+
+    auto parentvisits = 0;
+    for (auto child = root.get_first_child(); child != nullptr;
+         child = child->get_sibling()) {
+        auto visits = static_cast<int>(child->get_score() * 10000.0f);
+        child->set_visits(visits);
+        child->set_blackevals(visits * (0.4 + 0.2 * rng.randflt()));
+        parentvisits += visits;
+    }
+    root.set_visits(parentvisits);
+
+    run_bench(config, "uctnode_uct_select_child", [&root]() {
+        auto ops = size_t{0};
+        for (auto i = 0; i < 2000; i++) {
+            auto child = root.uct_select_child(FastBoard::BLACK);
+            g_sink += child->get_move();
+            ops++;
+        }
+        return ops;
+    });
+}
+
+void bench_ttable(const BenchConfig& config) {
+    constexpr auto ENTRIES = 100000;
+    auto rng = Random{BENCH_SEED};
+    auto hashes = std::vector<uint64>{};
+    for (auto i = 0; i < ENTRIES; i++) {
+        hashes.emplace_back(rng());
+    }
+    UCTNode node{FastBoard::PASS, 0.0f, 0.5f};
+    node.set_visits(100);
+    node.set_blackevals(50.0);
+
+    run_bench(config, "ttable_update", [&hashes, &node]() {
+        for (auto hash : hashes) {
+            TTable::get_TT()->update(hash, 7.5f, &node);
+        }
+        return hashes.size();
+    });
+
+    run_bench(config, "ttable_sync", [&hashes]() {
+        UCTNode target{FastBoard::PASS, 0.0f, 0.5f};
+        for (auto hash : hashes) {
+            TTable::get_TT()->sync(hash, 7.5f, &target);
+        }
+        g_sink += target.get_visits();
+        return hashes.size();
+    });
+}
+
+void bench_sgf(const BenchConfig& config, const std::vector<movelist_t>& games) {
+    auto collection = std::string{};
+    for (const auto& game : games) {
+        auto state = replay(game, game.size());
+        collection.append(SGFTree::state_to_string(state, FastBoard::BLACK));
+    }
+
+    run_bench(config, "sgfparser_chop_stream", [&collection]() {
+        auto ops = size_t{0};
+        for (auto rep = 0; rep < 10; rep++) {
+            auto strm = std::istringstream{collection};
+            auto chopped = SGFParser::chop_stream(strm);
+            ops += chopped.size();
+        }
+        return ops;
+    });
+
+    run_bench(config, "sgffile_scan", [&collection]() {
+        auto ops = size_t{0};
+        for (auto rep = 0; rep < 10; rep++) {
+            ops += SGFFile::scan(collection).size();
+        }
+        return ops;
+    });
+}
+
+void bench_chunker(const BenchConfig& config, const std::vector<movelist_t>& games) {
+    // Training records are about 2kB of text each.
+    auto records = std::vector<std::string>{};
+    auto rng = Random{BENCH_SEED};
+    for (auto i = 0; i < 64; i++) {
+        auto out = std::stringstream{};
+        auto state = replay(games[i % games.size()], i * 3);
+        auto planes = Network::NNPlanes{};
+        Network::gather_features(&state, planes);
+        for (auto p = size_t{0}; p < 16; p++) {
+            out << planes[p].to_string() << std::endl;
+        }
+        for (auto j = 0; j < 362; j++) {
+            out << rng.randflt() << " ";
+        }
+        out << std::endl << "1" << std::endl;
+        records.emplace_back(out.str());
+    }
+
+    const auto basename = std::string{"leelaz_bench_chunk"};
+    run_bench(config, "outputchunker_append", [&records, &basename]() {
+        // Stay below CHUNK_SIZE so that the single chunk is compressed
+        // and written when the chunker goes out of scope.
+        constexpr auto RECORDS = size_t{512};
+        static_assert(RECORDS < OutputChunker::CHUNK_SIZE, "one chunk only");
+        {
+            auto chunker = OutputChunker{basename, true};
+            for (auto i = size_t{0}; i < RECORDS; i++) {
+                chunker.append(records[i % records.size()]);
+            }
+        }
+        std::remove((basename + ".0.gz").c_str());
+        return RECORDS;
+    });
+}
+
+void bench_threadpool(const BenchConfig& config) {
+    constexpr auto TASKS = 10000;
+    run_bench(config, "threadpool_add_task", []() {
+        std::atomic<size_t> counter{0};
+        ThreadGroup tg(thread_pool);
+        for (auto i = 0; i < TASKS; i++) {
+            tg.add_task([&counter]() { counter++; });
+        }
+        tg.wait_all();
+        g_sink += counter;
+        return size_t(TASKS);
+    });
+    run_bench(config, "threadpool_add_tasks", []() {
+        std::atomic<size_t> counter{0};
+        ThreadGroup tg(thread_pool);
+        tg.add_tasks(TASKS, [&counter]() { counter++; });
+        tg.wait_all();
+        g_sink += counter;
+        return size_t(TASKS);
+    });
+}
+
+void bench_network(const BenchConfig& config, const std::vector<movelist_t>& games) {
+    auto state = replay(games.front(), games.front().size() / 2);
+
+    // The network is evaluated one position at a time per thread, so
+    // the effective batch size is the number of concurrent evaluators.
+    for (auto batch = 1; batch <= cfg_num_threads; batch *= 2) {
+        auto name = "network_forward_b" + std::to_string(batch);
+        run_bench(config, name, [&state, batch]() {
+            constexpr auto EVALS_PER_THREAD = 50;
+            ThreadGroup tg(thread_pool);
+            for (auto i = 0; i < batch; i++) {
+                tg.add_task([&state]() {
+                    auto mystate = state;
+                    for (auto j = 0; j < EVALS_PER_THREAD; j++) {
+                        auto result = Network::get_scored_moves(
+                            &mystate, Network::Ensemble::DIRECT, j % 8);
+                        g_sink += result.first.size();
+                    }
+                });
+            }
+            tg.wait_all();
+            return size_t(batch * EVALS_PER_THREAD);
+        });
+    }
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    namespace po = boost::program_options;
+
+    GTP::setup_default_parameters();
+
+    auto config = BenchConfig{};
+    po::options_description v_desc("Allowed options");
+    v_desc.add_options()
+        ("help,h", "Show commandline options.")
+        ("filter,f", po::value<std::string>(),
+                     "Only run benchmarks whose name contains this string.")
+        ("repeat,r", po::value<int>()->default_value(config.repeat),
+                     "Timed runs per benchmark, the median is reported.")
+        ("threads,t", po::value<int>()->default_value(cfg_num_threads),
+                      "Maximum number of threads for the network benchmarks.")
+        ("weights,w", po::value<std::string>(),
+                      "File with network weights. "
+                      "Network benchmarks are skipped without it.")
+        ;
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, v_desc), vm);
+        po::notify(vm);
+    } catch(const boost::program_options::error& e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        std::cerr << v_desc << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (vm.count("help")) {
+        std::cerr << v_desc << std::endl;
+        return EXIT_SUCCESS;
+    }
+    if (vm.count("filter")) {
+        config.filter = vm["filter"].as<std::string>();
+    }
+    config.repeat = std::max(1, vm["repeat"].as<int>());
+    cfg_num_threads = std::max(1, std::min(vm["threads"].as<int>(), MAX_CPUS));
+    cfg_rng_seed = BENCH_SEED;
+
+    thread_pool.initialize(cfg_num_threads);
+
+    auto zobrist_rng = std::make_unique<Random>(5489);
+    Zobrist::init_zobrist(*zobrist_rng);
+    Random::get_Rng().seedrandom(cfg_rng_seed);
+
+    auto rng = Random{BENCH_SEED};
+    auto games = std::vector<movelist_t>{};
+    for (auto i = 0; i < 32; i++) {
+        games.emplace_back(random_game(rng, 400));
+    }
+
+    printf("name,ops,ns_per_op_median,ns_per_op_min,ops_per_sec\n");
+
+    bench_board(config, games);
+    bench_superko(config, games);
+    bench_features(config, games);
+    bench_uct(config);
+    bench_ttable(config);
+    bench_sgf(config, games);
+    bench_chunker(config, games);
+    bench_threadpool(config);
+
+    if (vm.count("weights")) {
+        cfg_weightsfile = vm["weights"].as<std::string>();
+        Network::initialize();
+        bench_network(config, games);
+    } else {
+        myprintf("No weights given, skipping network benchmarks.\n");
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -24,10 +24,8 @@
  */
 #ifdef _WIN32
 #define GETTICKCOUNT
-#undef HAVE_SELECT
 #define NOMINMAX
 #else
-#define HAVE_SELECT
 #define GETTIMEOFDAY
 #endif
 
@@ -38,6 +36,8 @@
 #endif
 //#define USE_MKL
 #define USE_OPENCL
+// Let threads waiting on a busy lock sleep in the kernel (Linux only)
+#define USE_FUTEX
 // Use 16-bit floating point storage for net calculations
 // #define USE_HALF
 //#define USE_TUNER
@@ -45,11 +45,14 @@
 #define PROGRAM_NAME "Leela Zero"
 #define PROGRAM_VERSION "0.9"
 
-// OpenBLAS limitation
+#define MAX_CPUS 1024
+
+// OpenBLAS limitation. Above this many search threads, network
+// evaluations are handed to a separate pool of at most this size.
 #if defined(USE_BLAS) && defined(USE_OPENBLAS)
-#define MAX_CPUS 64
+#define MAX_BLAS_THREADS 64
 #else
-#define MAX_CPUS 128
+#define MAX_BLAS_THREADS MAX_CPUS
 #endif
 
 /* Integer types */